@@ -0,0 +1,35 @@
+// sokol-shdc -i data/yuv.glsl -o data/yuv.h -l glsl330:glsl100:hlsl4:metal_macos:metal_ios:metal_sim:wgpu -b
+// (the build regenerates data/yuv.h with this when sokol-shdc is on the PATH)
+@module yuv
+@vs vs
+in vec2 position;
+in vec2 texcoord0;
+out vec2 uv;
+void main() {
+    gl_Position = vec4(position, 0.5, 1.0);
+    uv = texcoord0;
+}
+@end
+
+@fs fs
+uniform fs_params {
+    vec4 coeff_r;
+    vec4 coeff_g;
+    vec4 coeff_b;
+    vec4 offset; // xyz are subtracted from the samples, w is 1 when tex_u holds interleaved UV (NV12)
+};
+uniform sampler2D tex_y;
+uniform sampler2D tex_u;
+uniform sampler2D tex_v;
+in vec2 uv;
+out vec4 frag_color;
+void main() {
+    vec3 yuv;
+    yuv.x = texture(tex_y, uv).r;
+    yuv.yz = offset.w > 0.5 ? texture(tex_u, uv).rg : vec2(texture(tex_u, uv).r, texture(tex_v, uv).r);
+    yuv -= offset.xyz;
+    frag_color = vec4(dot(coeff_r.xyz, yuv), dot(coeff_g.xyz, yuv), dot(coeff_b.xyz, yuv), 1.0);
+}
+@end
+
+@program yuv vs fs
@@ -0,0 +1,235 @@
+#pragma once
+/*
+    Written by hand in the layout sokol-shdc produces for data/yuv.glsl, with only the glsl330 and hlsl4 outputs.
+    The build regenerates it with the same options as box.h whenever sokol-shdc
+    (https://github.com/floooh/sokol-tools) is on the PATH, which adds the other backends:
+
+    Cmdline: sokol-shdc -i data/yuv.glsl -o data/yuv.h -l glsl330:glsl100:hlsl4:metal_macos:metal_ios:metal_sim:wgpu -b
+
+    tests/test_yuv_shader.c checks the glsl330 output against the BT.601/BT.709 maths on llvmpipe.
+
+    Overview:
+
+        Shader program 'yuv':
+            Get shader desc: yuv_shader_desc(sg_query_backend());
+            Vertex shader: vs
+                Attribute slots:
+                    ATTR_yuv_vs_position = 0
+                    ATTR_yuv_vs_texcoord0 = 1
+            Fragment shader: fs
+                Uniform block 'fs_params':
+                    C struct: yuv_fs_params_t
+                    Bind slot: SLOT_yuv_fs_params = 0
+                Image 'tex_y':
+                    Type: SG_IMAGETYPE_2D
+                    Component Type: SG_SAMPLERTYPE_FLOAT
+                    Bind slot: SLOT_yuv_tex_y = 0
+                Image 'tex_u':
+                    Type: SG_IMAGETYPE_2D
+                    Component Type: SG_SAMPLERTYPE_FLOAT
+                    Bind slot: SLOT_yuv_tex_u = 1
+                Image 'tex_v':
+                    Type: SG_IMAGETYPE_2D
+                    Component Type: SG_SAMPLERTYPE_FLOAT
+                    Bind slot: SLOT_yuv_tex_v = 2
+
+    yuv_shader_desc() returns NULL on the backends that aren't included here.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#if !defined(SOKOL_SHDC_ALIGN)
+  #if defined(_MSC_VER)
+    #define SOKOL_SHDC_ALIGN(a) __declspec(align(a))
+  #else
+    #define SOKOL_SHDC_ALIGN(a) __attribute__((aligned(a)))
+  #endif
+#endif
+#define ATTR_yuv_vs_position (0)
+#define ATTR_yuv_vs_texcoord0 (1)
+#define SLOT_yuv_tex_y (0)
+#define SLOT_yuv_tex_u (1)
+#define SLOT_yuv_tex_v (2)
+#define SLOT_yuv_fs_params (0)
+#pragma pack(push,1)
+SOKOL_SHDC_ALIGN(16) typedef struct yuv_fs_params_t {
+    float coeff_r[4];
+    float coeff_g[4];
+    float coeff_b[4];
+    float offset[4];
+} yuv_fs_params_t;
+#pragma pack(pop)
+static const char yuv_vs_source_glsl330[] =
+    "#version 330\n"
+    "\n"
+    "layout(location = 0) in vec2 position;\n"
+    "out vec2 uv;\n"
+    "layout(location = 1) in vec2 texcoord0;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(position, 0.5, 1.0);\n"
+    "    uv = texcoord0;\n"
+    "}\n"
+    "\n";
+static const char yuv_fs_source_glsl330[] =
+    "#version 330\n"
+    "\n"
+    "uniform vec4 fs_params[4];\n"
+    "uniform sampler2D tex_y;\n"
+    "uniform sampler2D tex_u;\n"
+    "uniform sampler2D tex_v;\n"
+    "\n"
+    "in vec2 uv;\n"
+    "layout(location = 0) out vec4 frag_color;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 yuv;\n"
+    "    yuv.x = texture(tex_y, uv).x;\n"
+    "    vec2 c;\n"
+    "    if (fs_params[3].w > 0.5)\n"
+    "    {\n"
+    "        c = texture(tex_u, uv).xy;\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        c = vec2(texture(tex_u, uv).x, texture(tex_v, uv).x);\n"
+    "    }\n"
+    "    yuv.yz = c;\n"
+    "    yuv -= fs_params[3].xyz;\n"
+    "    frag_color = vec4(dot(fs_params[0].xyz, yuv), dot(fs_params[1].xyz, yuv), dot(fs_params[2].xyz, yuv), "
+    "1.0);\n"
+    "}\n"
+    "\n";
+static const char yuv_vs_source_hlsl4[] =
+    "struct SPIRV_Cross_Input\n"
+    "{\n"
+    "    float2 position : TEXCOORD0;\n"
+    "    float2 texcoord0 : TEXCOORD1;\n"
+    "};\n"
+    "\n"
+    "struct SPIRV_Cross_Output\n"
+    "{\n"
+    "    float2 uv : TEXCOORD0;\n"
+    "    float4 gl_Position : SV_Position;\n"
+    "};\n"
+    "\n"
+    "SPIRV_Cross_Output main(SPIRV_Cross_Input stage_input)\n"
+    "{\n"
+    "    SPIRV_Cross_Output stage_output;\n"
+    "    stage_output.gl_Position = float4(stage_input.position, 0.5f, 1.0f);\n"
+    "    stage_output.uv = stage_input.texcoord0;\n"
+    "    return stage_output;\n"
+    "}\n";
+static const char yuv_fs_source_hlsl4[] =
+    "cbuffer fs_params : register(b0)\n"
+    "{\n"
+    "    float4 _coeff_r : packoffset(c0);\n"
+    "    float4 _coeff_g : packoffset(c1);\n"
+    "    float4 _coeff_b : packoffset(c2);\n"
+    "    float4 _offset : packoffset(c3);\n"
+    "};\n"
+    "\n"
+    "Texture2D<float4> tex_y : register(t0);\n"
+    "SamplerState _tex_y_sampler : register(s0);\n"
+    "Texture2D<float4> tex_u : register(t1);\n"
+    "SamplerState _tex_u_sampler : register(s1);\n"
+    "Texture2D<float4> tex_v : register(t2);\n"
+    "SamplerState _tex_v_sampler : register(s2);\n"
+    "\n"
+    "struct SPIRV_Cross_Input\n"
+    "{\n"
+    "    float2 uv : TEXCOORD0;\n"
+    "};\n"
+    "\n"
+    "struct SPIRV_Cross_Output\n"
+    "{\n"
+    "    float4 frag_color : SV_Target0;\n"
+    "};\n"
+    "\n"
+    "SPIRV_Cross_Output main(SPIRV_Cross_Input stage_input)\n"
+    "{\n"
+    "    float3 yuv;\n"
+    "    yuv.x = tex_y.Sample(_tex_y_sampler, stage_input.uv).x;\n"
+    "    float2 c;\n"
+    "    if (_offset.w > 0.5f)\n"
+    "    {\n"
+    "        c = tex_u.Sample(_tex_u_sampler, stage_input.uv).xy;\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        c = float2(tex_u.Sample(_tex_u_sampler, stage_input.uv).x, tex_v.Sample(_tex_v_sampler, "
+    "stage_input.uv).x);\n"
+    "    }\n"
+    "    yuv.yz = c;\n"
+    "    yuv -= _offset.xyz;\n"
+    "    SPIRV_Cross_Output stage_output;\n"
+    "    stage_output.frag_color = float4(dot(_coeff_r.xyz, yuv), dot(_coeff_g.xyz, yuv), dot(_coeff_b.xyz, yuv), "
+    "1.0f);\n"
+    "    return stage_output;\n"
+    "}\n";
+#if !defined(SOKOL_GFX_INCLUDED)
+  #error "Please include sokol_gfx.h before yuv.h"
+#endif
+static inline const sg_shader_desc* yuv_shader_desc(sg_backend backend) {
+  if (backend == SG_BACKEND_GLCORE33) {
+    static sg_shader_desc desc;
+    static bool valid;
+    if (!valid) {
+      valid = true;
+      desc.attrs[0].name = "position";
+      desc.attrs[1].name = "texcoord0";
+      desc.vs.source = yuv_vs_source_glsl330;
+      desc.vs.entry = "main";
+      desc.fs.source = yuv_fs_source_glsl330;
+      desc.fs.entry = "main";
+      desc.fs.uniform_blocks[0].size = 64;
+      desc.fs.uniform_blocks[0].uniforms[0].name = "fs_params";
+      desc.fs.uniform_blocks[0].uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+      desc.fs.uniform_blocks[0].uniforms[0].array_count = 4;
+      desc.fs.images[0].name = "tex_y";
+      desc.fs.images[0].image_type = SG_IMAGETYPE_2D;
+      desc.fs.images[0].sampler_type = SG_SAMPLERTYPE_FLOAT;
+      desc.fs.images[1].name = "tex_u";
+      desc.fs.images[1].image_type = SG_IMAGETYPE_2D;
+      desc.fs.images[1].sampler_type = SG_SAMPLERTYPE_FLOAT;
+      desc.fs.images[2].name = "tex_v";
+      desc.fs.images[2].image_type = SG_IMAGETYPE_2D;
+      desc.fs.images[2].sampler_type = SG_SAMPLERTYPE_FLOAT;
+      desc.label = "yuv_shader";
+    }
+    return &desc;
+  }
+  if (backend == SG_BACKEND_D3D11) {
+    static sg_shader_desc desc;
+    static bool valid;
+    if (!valid) {
+      valid = true;
+      desc.attrs[0].sem_name = "TEXCOORD";
+      desc.attrs[0].sem_index = 0;
+      desc.attrs[1].sem_name = "TEXCOORD";
+      desc.attrs[1].sem_index = 1;
+      desc.vs.source = yuv_vs_source_hlsl4;
+      desc.vs.d3d11_target = "vs_4_0";
+      desc.vs.entry = "main";
+      desc.fs.source = yuv_fs_source_hlsl4;
+      desc.fs.d3d11_target = "ps_4_0";
+      desc.fs.entry = "main";
+      desc.fs.uniform_blocks[0].size = 64;
+      desc.fs.images[0].name = "tex_y";
+      desc.fs.images[0].image_type = SG_IMAGETYPE_2D;
+      desc.fs.images[0].sampler_type = SG_SAMPLERTYPE_FLOAT;
+      desc.fs.images[1].name = "tex_u";
+      desc.fs.images[1].image_type = SG_IMAGETYPE_2D;
+      desc.fs.images[1].sampler_type = SG_SAMPLERTYPE_FLOAT;
+      desc.fs.images[2].name = "tex_v";
+      desc.fs.images[2].image_type = SG_IMAGETYPE_2D;
+      desc.fs.images[2].sampler_type = SG_SAMPLERTYPE_FLOAT;
+      desc.label = "yuv_shader";
+    }
+    return &desc;
+  }
+  return 0;
+}
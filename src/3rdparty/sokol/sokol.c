@@ -18,6 +18,8 @@
 #include <sokol/sokol_fontstash.h>
 #define SOKOL_AUDIO_IMPL
 #include <sokol/sokol_audio.h>
+#define SOKOL_TIME_IMPL
+#include <sokol/sokol_time.h>
 
 #ifdef _DEBUG
 void DebugLogStr(const char* s) {
@@ -0,0 +1,307 @@
+#include "audio.h"
+#include <thread/thread.h>
+#include <sokol/sokol_time.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
+// frames decoded + mixed per pass of the audio thread
+#define AUDIO_CHUNK_FRAMES (512)
+// length of the fade at either end of a clip
+#define AUDIO_FADE_SECS (0.01)
+// the limiter keeps peaks below this, and lets go again at roughly 1/AUDIO_LIMITER_RELEASE blocks
+#define AUDIO_LIMITER_CEILING (0.98f)
+#define AUDIO_LIMITER_RELEASE (0.05f)
+
+// a source as seen by the audio thread. gains ramp linearly across a block from where the last block ended, so gain
+// changes, clips appearing and the fades at clip boundaries don't click
+typedef struct {
+  VideoId vid;
+  int gen;
+  float gain, cur_gain;
+  int64_t from_start, to_end; // in frames, moved along as blocks are mixed and reset by every update
+} AudioVoice;
+
+typedef struct {
+  // the audio thread only moves write_pos + flush_pos, the callback only moves read_pos. the positions count frames,
+  // they keep increasing and wrap around, so distances between them are taken as unsigned differences
+  float ring[AUDIO_RING_FRAMES * AUDIO_MAX_CHANNELS];
+  thread_atomic_int_t write_pos, read_pos;
+  thread_atomic_int_t flush_pos; // the callback skips everything written before this
+  thread_atomic_int_t running;
+  thread_atomic_int_t underruns, underrun_frames;
+  thread_atomic_int_t mix_usecs, mixed_frames; // both wrap around
+  // the clock, written by the callback under a sequence count that's odd while it's being changed. played_frames only
+  // counts frames copied out of the ring, played_usecs is when the last callback ran and played_block how many frames
+  // it copied, which bounds how far the clock is interpolated past it
+  thread_atomic_int_t clock_seq, played_frames, played_usecs, played_block;
+
+  int sample_rate, num_channels;
+  thread_mutex_t* aud_thread_mtx;
+  // protected by aud_thread_mtx
+  AudioSource sources[AUDIO_MAX_SOURCES];
+  int num_sources, sources_seq;
+  thread_ptr_t thread;
+  thread_atomic_int_t exit;
+
+  // owned by the audio thread
+  AudioVoice voices[AUDIO_MAX_SOURCES];
+  int num_voices, voices_seq;
+  float limiter_gain;
+  uint64_t mix_ticks;
+} Audio;
+static Audio _audio;
+
+static int audio_distance(int from, int to) {
+  return (int)((unsigned)to - (unsigned)from);
+}
+
+// wraps around like the ring positions
+static int audio_usecs(void) {
+  return (int)(uint32_t)(uint64_t)stm_us(stm_now());
+}
+
+// copies num_frames between the ring at pos and buf, wrapping around the end of the ring
+static void audio_ringcopy(Audio* a, int pos, float* buf, int num_frames, bool toring) {
+  int start = (int)((unsigned)pos % AUDIO_RING_FRAMES);
+  int first = num_frames < AUDIO_RING_FRAMES - start ? num_frames : AUDIO_RING_FRAMES - start;
+  size_t framebytes = sizeof(float) * a->num_channels;
+  float* ring = a->ring + start * a->num_channels;
+  if (toring) {
+    memcpy(ring, buf, first * framebytes);
+    memcpy(a->ring, buf + first * a->num_channels, (num_frames - first) * framebytes);
+  } else {
+    memcpy(buf, ring, first * framebytes);
+    memcpy(buf + first * a->num_channels, a->ring, (num_frames - first) * framebytes);
+  }
+}
+
+// mixes src into dst with the gain ramping from g0 to g1 over the block
+static void audio_mixramp(float* dst, const float* src, int num_frames, int num_channels, float g0, float g1) {
+  int n = num_frames * num_channels, i = 0;
+  float step = (g1 - g0) / (float)num_frames;
+#ifdef AUDIO_SSE2
+  // 4 samples are 2 stereo frames or 4 mono ones
+  float g[4];
+  for (int k = 0; k < 4; k++) {
+    g[k] = g0 + step * (float)(k / num_channels);
+  }
+  __m128 gain = _mm_loadu_ps(g), inc = _mm_set1_ps(step * (float)(4 / num_channels));
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), gain);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), x));
+    gain = _mm_add_ps(gain, inc);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] += src[i] * (g0 + step * (float)(i / num_channels));
+  }
+}
+
+// scales the block so its peak stays under the ceiling, then recovers slowly. the gain ramps across the block, a peak
+// right at the start can still be above the ceiling so the output is clamped as well
+static void audio_limit(Audio* a, float* buf, int n) {
+  float peak = 0.0f;
+  int i = 0;
+#ifdef AUDIO_SSE2
+  const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 peak4 = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    peak4 = _mm_max_ps(peak4, _mm_and_ps(_mm_loadu_ps(buf + i), absmask));
+  }
+  float p[4];
+  _mm_storeu_ps(p, peak4);
+  peak = fmaxf(fmaxf(p[0], p[1]), fmaxf(p[2], p[3]));
+#endif
+  for (; i < n; i++) {
+    peak = fmaxf(peak, fabsf(buf[i]));
+  }
+  float g0 = a->limiter_gain, g1 = g0 + (1.0f - g0) * AUDIO_LIMITER_RELEASE;
+  if (peak * g1 > AUDIO_LIMITER_CEILING) {
+    g1 = AUDIO_LIMITER_CEILING / peak;
+  }
+  a->limiter_gain = g1;
+  if (g0 == 1.0f && g1 == 1.0f) {
+    return;
+  }
+  float step = (g1 - g0) / (float)n;
+  for (i = 0; i < n; i++) {
+    float x = buf[i] * (g0 + step * (float)i);
+    buf[i] = x > 1.0f ? 1.0f : (x < -1.0f ? -1.0f : x);
+  }
+}
+
+static float audio_envelope(Audio* a, int64_t from_start, int64_t to_end) {
+  double fade = AUDIO_FADE_SECS * a->sample_rate;
+  double env = fmin(fmin((double)from_start / fade, (double)to_end / fade), 1.0);
+  return env > 0.0 ? (float)env : 0.0f;
+}
+
+// picks up the sources posted by the main thread: known videos keep their gain ramp, new ones fade in from silence
+static void audio_updatevoices_underlock(Audio* a) {
+  AudioVoice voices[AUDIO_MAX_SOURCES];
+  for (int i = 0; i < a->num_sources; i++) {
+    const AudioSource* src = &a->sources[i];
+    AudioVoice* voice = &voices[i];
+    *voice = (AudioVoice){.vid = src->vid, .gen = video_audiogen_underlock(src->vid)};
+    for (int j = 0; j < a->num_voices; j++) {
+      if (a->voices[j].vid.id == src->vid.id) {
+        *voice = a->voices[j];
+        break;
+      }
+    }
+    voice->gain = src->gain;
+    voice->from_start = (int64_t)(src->from_start_secs * a->sample_rate);
+    voice->to_end = (int64_t)(src->to_end_secs * a->sample_rate);
+  }
+  memcpy(a->voices, voices, sizeof(AudioVoice) * a->num_sources);
+  a->num_voices = a->num_sources;
+  a->voices_seq = a->sources_seq;
+}
+
+static int audio_thread(void* user_data) {
+  Audio* a = (Audio*)user_data;
+  thread_set_high_priority();
+#ifdef AUDIO_SSE2
+  // flush denormals to zero, fades + the limiter release decay towards them
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+  thread_timer_t timer;
+  thread_timer_init(&timer);
+  float chunk[AUDIO_CHUNK_FRAMES * AUDIO_MAX_CHANNELS];
+  float mix[AUDIO_CHUNK_FRAMES * AUDIO_MAX_CHANNELS];
+  a->limiter_gain = 1.0f;
+  while (thread_atomic_int_load(&a->exit) == 0) {
+    int write_pos = thread_atomic_int_load(&a->write_pos);
+    int read_pos = thread_atomic_int_load(&a->read_pos);
+    if (AUDIO_RING_FRAMES - audio_distance(read_pos, write_pos) < AUDIO_CHUNK_FRAMES) {
+      thread_timer_wait(&timer, 2000000); // ring is full, a chunk takes ~10ms to play
+      continue;
+    }
+    uint64_t start = stm_now();
+    memset(mix, 0, sizeof(mix));
+    bool flush = false;
+    thread_mutex_lock(a->aud_thread_mtx);
+    if (a->voices_seq != a->sources_seq) {
+      audio_updatevoices_underlock(a);
+    }
+    for (int i = 0; i < a->num_voices; i++) {
+      AudioVoice* voice = &a->voices[i];
+      // after a seek whatever is still in the ring is from the old position
+      int gen = video_audiogen_underlock(voice->vid);
+      flush |= gen != voice->gen;
+      voice->gen = gen;
+      video_getaudio_underlock(voice->vid, chunk, AUDIO_CHUNK_FRAMES, a->num_channels, a->sample_rate);
+      voice->from_start += AUDIO_CHUNK_FRAMES;
+      voice->to_end -= AUDIO_CHUNK_FRAMES;
+      float gain = voice->gain * audio_envelope(a, voice->from_start, voice->to_end);
+      if (gain != 0.0f || voice->cur_gain != 0.0f) {
+        audio_mixramp(mix, chunk, AUDIO_CHUNK_FRAMES, a->num_channels, voice->cur_gain, gain);
+      }
+      voice->cur_gain = gain;
+    }
+    thread_mutex_unlock(a->aud_thread_mtx);
+    if (flush) {
+      thread_atomic_int_store(&a->flush_pos, write_pos);
+    }
+    audio_limit(a, mix, AUDIO_CHUNK_FRAMES * a->num_channels);
+    audio_ringcopy(a, write_pos, mix, AUDIO_CHUNK_FRAMES, true);
+    thread_atomic_int_store(&a->write_pos, (int)((unsigned)write_pos + AUDIO_CHUNK_FRAMES));
+    // summed in ticks so short passes don't all round down to nothing
+    a->mix_ticks += stm_since(start);
+    thread_atomic_int_store(&a->mix_usecs, (int)(uint32_t)(uint64_t)stm_us(a->mix_ticks));
+    thread_atomic_int_add(&a->mixed_frames, AUDIO_CHUNK_FRAMES);
+  }
+  thread_timer_term(&timer);
+  return 0;
+}
+
+void audio_init(int sample_rate, int num_channels, thread_mutex_t* aud_thread_mtx) {
+  Audio* a = &_audio;
+  assert(num_channels >= 1 && num_channels <= AUDIO_MAX_CHANNELS);
+  a->sample_rate = sample_rate;
+  a->num_channels = num_channels;
+  a->aud_thread_mtx = aud_thread_mtx;
+  thread_atomic_int_store(&a->exit, 0);
+  a->thread = thread_create(audio_thread, a, "audio decode", THREAD_STACK_SIZE_DEFAULT);
+  thread_atomic_int_store(&a->running, 1);
+}
+
+void audio_shutdown(void) {
+  Audio* a = &_audio;
+  if (thread_atomic_int_load(&a->running) == 0) {
+    return;
+  }
+  thread_atomic_int_store(&a->running, 0);
+  thread_atomic_int_store(&a->exit, 1);
+  thread_join(a->thread);
+  thread_destroy(a->thread);
+}
+
+void audio_setsources_underlock(const AudioSource* sources, int num_sources) {
+  Audio* a = &_audio;
+  a->num_sources = num_sources < AUDIO_MAX_SOURCES ? num_sources : AUDIO_MAX_SOURCES;
+  if (a->num_sources) {
+    memcpy(a->sources, sources, sizeof(AudioSource) * a->num_sources); // sources can be NULL when clearing them
+  }
+  a->sources_seq++;
+}
+
+void audio_callback(float* buffer, int num_frames, int num_channels) {
+  Audio* a = &_audio;
+  int num_copied = 0;
+  if (thread_atomic_int_load(&a->running) && num_channels == a->num_channels) {
+    int read_pos = thread_atomic_int_load(&a->read_pos);
+    int flush_pos = thread_atomic_int_load(&a->flush_pos);
+    if (audio_distance(read_pos, flush_pos) > 0) {
+      read_pos = flush_pos;
+    }
+    int available = audio_distance(read_pos, thread_atomic_int_load(&a->write_pos));
+    num_copied = available < num_frames ? available : num_frames;
+    audio_ringcopy(a, read_pos, buffer, num_copied, false);
+    thread_atomic_int_store(&a->read_pos, (int)((unsigned)read_pos + num_copied));
+    thread_atomic_int_inc(&a->clock_seq);
+    thread_atomic_int_add(&a->played_frames, num_copied);
+    thread_atomic_int_store(&a->played_usecs, audio_usecs());
+    thread_atomic_int_store(&a->played_block, num_copied);
+    thread_atomic_int_inc(&a->clock_seq);
+    if (num_copied < num_frames) {
+      thread_atomic_int_inc(&a->underruns);
+      thread_atomic_int_add(&a->underrun_frames, num_frames - num_copied);
+    }
+  }
+  memset(buffer + num_copied * num_channels, 0, sizeof(float) * (num_frames - num_copied) * num_channels);
+}
+
+double audio_clock_secs(void) {
+  Audio* a = &_audio;
+  if (a->sample_rate == 0) {
+    return 0.0;
+  }
+  int seq, frames, usecs, block;
+  do {
+    seq = thread_atomic_int_load(&a->clock_seq);
+    frames = thread_atomic_int_load(&a->played_frames);
+    usecs = thread_atomic_int_load(&a->played_usecs);
+    block = thread_atomic_int_load(&a->played_block);
+  } while ((seq & 1) || seq != thread_atomic_int_load(&a->clock_seq));
+  double since = audio_distance(usecs, audio_usecs()) * 1e-6;
+  double maxsince = (double)block / a->sample_rate;
+  since = since < 0.0 ? 0.0 : (since > maxsince ? maxsince : since);
+  return (double)(unsigned)frames / a->sample_rate + since;
+}
+
+AudioStats audio_stats(void) {
+  Audio* a = &_audio;
+  return (AudioStats){
+      .underruns = thread_atomic_int_load(&a->underruns),
+      .underrun_frames = thread_atomic_int_load(&a->underrun_frames),
+      .mix_usecs = thread_atomic_int_load(&a->mix_usecs),
+      .mixed_frames = thread_atomic_int_load(&a->mixed_frames),
+  };
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "video.h"
+
+// decodes + mixes the audio of every clip under the playhead on its own thread into a lock-free single
+// producer/single consumer ring. the audio callback only copies out of the ring, it never waits on a lock or touches a
+// decoder
+
+#define AUDIO_RING_FRAMES (4096) // power of 2, ~85ms at 48kHz
+#define AUDIO_MAX_CHANNELS (2)
+#define AUDIO_MAX_SOURCES (64)
+
+void audio_init(int sample_rate, int num_channels, thread_mutex_t* aud_thread_mtx);
+void audio_shutdown(void);
+
+typedef struct {
+  VideoId vid;
+  float gain;                           // linear
+  double from_start_secs, to_end_secs; // distance of the playhead from the clip's ends, for the boundary fades
+} AudioSource;
+// the videos to mix, replaces the previous set. assumes aud_thread_mtx is locked
+void audio_setsources_underlock(const AudioSource* sources, int num_sources);
+
+// the saudio stream callback
+void audio_callback(float* buffer, int num_frames, int num_channels);
+
+// seconds of audio the device has played since audio_init, interpolated between callbacks. it only moves while the
+// ring is feeding the device, so a playhead driven by it stays locked to what's heard
+double audio_clock_secs(void);
+
+typedef struct {
+  int underruns;        // callbacks that ran out of decoded audio and were padded with silence
+  int underrun_frames;
+  // time the audio thread has spent decoding + mixing and the frames it mixed in that time. both wrap around, take
+  // the unsigned difference between two samples
+  int mix_usecs, mixed_frames;
+} AudioStats;
+AudioStats audio_stats(void);
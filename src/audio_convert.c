@@ -0,0 +1,326 @@
+#include "audio_convert.h"
+#include <libavutil/frame.h>
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
+// the SIMD path mixes at most this many input channels (7.1), more go through swresample
+#define AUDIO_MAX_MIX_CHANNELS (8)
+
+struct AudioConvert {
+  // planar float copies of the input channels that aren't planar float already
+  float* scratch;
+  int scratch_len;
+  float* out;
+  int out_len;
+
+  struct SwrContext* swr;
+  AVChannelLayout swr_in_layout;
+  int swr_in_rate, swr_in_format, swr_out_rate, swr_out_channels;
+};
+
+AudioConvert* audioconvert_create(void) {
+  return (AudioConvert*)calloc(1, sizeof(AudioConvert));
+}
+
+void audioconvert_free(AudioConvert* c) {
+  if (c == NULL) {
+    return;
+  }
+  swr_free(&c->swr);
+  av_channel_layout_uninit(&c->swr_in_layout);
+  free(c->scratch);
+  free(c->out);
+  free(c);
+}
+
+void audioconvert_reset(AudioConvert* c) {
+  swr_free(&c->swr); // remade by the next frame
+}
+
+static float* audioconvert_grow(float** buf, int* len, int needed) {
+  if (*len < needed) {
+    free(*buf);
+    *buf = (float*)malloc(sizeof(float) * needed);
+    *len = needed;
+  }
+  return *buf;
+}
+
+static void audioconvert_u8(const uint8_t* src, float* dst, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i] = (float)(src[i] - 128) * (1.0f / 128.0f);
+  }
+}
+
+static void audioconvert_s16(const int16_t* src, float* dst, int n) {
+  int i = 0;
+#ifdef AUDIO_SSE2
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  for (; i + 8 <= n; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    // sign extend by putting the samples in the high halves and shifting down
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (float)src[i] * (1.0f / 32768.0f);
+  }
+}
+
+static void audioconvert_s32(const int32_t* src, float* dst, int n) {
+  int i = 0;
+#ifdef AUDIO_SSE2
+  const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+  for (; i + 4 <= n; i += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(s), scale));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (float)src[i] * (1.0f / 2147483648.0f);
+  }
+}
+
+static void audioconvert_dbl(const double* src, float* dst, int n) {
+  int i = 0;
+#ifdef AUDIO_SSE2
+  for (; i + 4 <= n; i += 4) {
+    __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+    __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+    _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (float)src[i];
+  }
+}
+
+// converts n samples of a packed or planar format to float, returns false for formats without a kernel
+static bool audioconvert_samples(enum AVSampleFormat format, const uint8_t* src, float* dst, int n) {
+  switch (av_get_packed_sample_fmt(format)) {
+  case AV_SAMPLE_FMT_U8:
+    audioconvert_u8(src, dst, n);
+    return true;
+  case AV_SAMPLE_FMT_S16:
+    audioconvert_s16((const int16_t*)src, dst, n);
+    return true;
+  case AV_SAMPLE_FMT_S32:
+    audioconvert_s32((const int32_t*)src, dst, n);
+    return true;
+  case AV_SAMPLE_FMT_FLT:
+    memcpy(dst, src, sizeof(float) * n);
+    return true;
+  case AV_SAMPLE_FMT_DBL:
+    audioconvert_dbl((const double*)src, dst, n);
+    return true;
+  default:
+    return false;
+  }
+}
+
+// the weights of each input channel in the left and right output, the ITU-R BS.775 downmix: front channels go straight
+// through while centre and surrounds are mixed in at -3dB and the LFE is dropped. nothing is normalised, so dialogue
+// stays as loud as it is in a stereo mix, the limiter in the audio thread catches the rare peak that goes over
+static void audioconvert_downmix(const AVChannelLayout* layout, float mix[2][AUDIO_MAX_MIX_CHANNELS]) {
+  const float m3db = 0.70710678f;
+  int num = layout->nb_channels;
+  memset(mix, 0, sizeof(float) * 2 * AUDIO_MAX_MIX_CHANNELS);
+  if (num == 1) {
+    mix[0][0] = mix[1][0] = 1.0f;
+    return;
+  }
+  if (layout->order == AV_CHANNEL_ORDER_UNSPEC) {
+    mix[0][0] = mix[1][1] = 1.0f; // no idea what the rest are
+    return;
+  }
+  for (int i = 0; i < num; i++) {
+    switch (av_channel_layout_channel_from_index(layout, i)) {
+    case AV_CHAN_FRONT_LEFT:
+      mix[0][i] = 1.0f;
+      break;
+    case AV_CHAN_FRONT_RIGHT:
+      mix[1][i] = 1.0f;
+      break;
+    case AV_CHAN_FRONT_CENTER:
+      mix[0][i] = mix[1][i] = m3db;
+      break;
+    case AV_CHAN_LOW_FREQUENCY:
+      break;
+    case AV_CHAN_SIDE_LEFT:
+    case AV_CHAN_BACK_LEFT:
+    case AV_CHAN_FRONT_LEFT_OF_CENTER:
+      mix[0][i] = m3db;
+      break;
+    case AV_CHAN_SIDE_RIGHT:
+    case AV_CHAN_BACK_RIGHT:
+    case AV_CHAN_FRONT_RIGHT_OF_CENTER:
+      mix[1][i] = m3db;
+      break;
+    default:
+      mix[0][i] = mix[1][i] = 0.5f;
+      break;
+    }
+  }
+}
+
+// mixes planar float channels into interleaved stereo
+static void audioconvert_mixstereo(const float* const* planes, int num_planes, float mix[2][AUDIO_MAX_MIX_CHANNELS],
+                                   float* dst, int n) {
+  int i = 0;
+#ifdef AUDIO_SSE2
+  for (; i + 4 <= n; i += 4) {
+    __m128 l = _mm_setzero_ps(), r = _mm_setzero_ps();
+    for (int c = 0; c < num_planes; c++) {
+      __m128 x = _mm_loadu_ps(planes[c] + i);
+      l = _mm_add_ps(l, _mm_mul_ps(x, _mm_set1_ps(mix[0][c])));
+      r = _mm_add_ps(r, _mm_mul_ps(x, _mm_set1_ps(mix[1][c])));
+    }
+    _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(l, r));
+    _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(l, r));
+  }
+#endif
+  for (; i < n; i++) {
+    float l = 0.0f, r = 0.0f;
+    for (int c = 0; c < num_planes; c++) {
+      l += planes[c][i] * mix[0][c];
+      r += planes[c][i] * mix[1][c];
+    }
+    dst[i * 2] = l;
+    dst[i * 2 + 1] = r;
+  }
+}
+
+// mixes planar float channels into mono
+static void audioconvert_mixmono(const float* const* planes, int num_planes, float mix[2][AUDIO_MAX_MIX_CHANNELS],
+                                 float* dst, int n) {
+  int i = 0;
+#ifdef AUDIO_SSE2
+  for (; i + 4 <= n; i += 4) {
+    __m128 m = _mm_setzero_ps();
+    for (int c = 0; c < num_planes; c++) {
+      __m128 w = _mm_set1_ps((mix[0][c] + mix[1][c]) * 0.5f);
+      m = _mm_add_ps(m, _mm_mul_ps(_mm_loadu_ps(planes[c] + i), w));
+    }
+    _mm_storeu_ps(dst + i, m);
+  }
+#endif
+  for (; i < n; i++) {
+    float m = 0.0f;
+    for (int c = 0; c < num_planes; c++) {
+      m += planes[c][i] * (mix[0][c] + mix[1][c]) * 0.5f;
+    }
+    dst[i] = m;
+  }
+}
+
+// the SIMD path, returns false if the frame needs swresample
+static bool audioconvert_direct(AudioConvert* c, const AVFrame* frame, int out_channels) {
+  int num = frame->ch_layout.nb_channels, n = frame->nb_samples;
+  if (num < 1 || num > AUDIO_MAX_MIX_CHANNELS) {
+    return false;
+  }
+  enum AVSampleFormat format = frame->format;
+  const float* planes[AUDIO_MAX_MIX_CHANNELS];
+  if (format == AV_SAMPLE_FMT_FLTP) {
+    for (int i = 0; i < num; i++) {
+      planes[i] = (const float*)frame->extended_data[i];
+    }
+  } else if (av_sample_fmt_is_planar(format)) {
+    float* scratch = audioconvert_grow(&c->scratch, &c->scratch_len, n * num);
+    for (int i = 0; i < num; i++) {
+      if (!audioconvert_samples(format, frame->extended_data[i], scratch + i * n, n)) {
+        return false;
+      }
+      planes[i] = scratch + i * n;
+    }
+  } else {
+    // packed: convert the whole buffer, then split it into planes for the mix
+    float* scratch = audioconvert_grow(&c->scratch, &c->scratch_len, n * num * 2);
+    float* packed = scratch + n * num;
+    if (!audioconvert_samples(format, frame->extended_data[0], packed, n * num)) {
+      return false;
+    }
+    if (num == out_channels && num <= 2) {
+      float* out = audioconvert_grow(&c->out, &c->out_len, n * num);
+      memcpy(out, packed, sizeof(float) * n * num);
+      return true;
+    }
+    for (int i = 0; i < num; i++) {
+      float* plane = scratch + i * n;
+      for (int j = 0; j < n; j++) {
+        plane[j] = packed[j * num + i];
+      }
+      planes[i] = plane;
+    }
+  }
+  float mix[2][AUDIO_MAX_MIX_CHANNELS];
+  audioconvert_downmix(&frame->ch_layout, mix);
+  float* out = audioconvert_grow(&c->out, &c->out_len, n * out_channels);
+  if (out_channels >= 2) {
+    audioconvert_mixstereo(planes, num, mix, out, n);
+  } else {
+    audioconvert_mixmono(planes, num, mix, out, n);
+  }
+  return true;
+}
+
+static int audioconvert_resample(AudioConvert* c, const AVFrame* frame, int out_rate, int out_channels) {
+  bool changed = c->swr_in_rate != frame->sample_rate || c->swr_in_format != frame->format ||
+                 c->swr_out_rate != out_rate || c->swr_out_channels != out_channels ||
+                 av_channel_layout_compare(&c->swr_in_layout, &frame->ch_layout) != 0;
+  if (c->swr == NULL || changed) {
+    swr_free(&c->swr);
+    av_channel_layout_uninit(&c->swr_in_layout);
+    av_channel_layout_copy(&c->swr_in_layout, &frame->ch_layout);
+    AVChannelLayout in_layout, out_layout;
+    // swresample needs to know where each channel goes
+    if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+      av_channel_layout_default(&in_layout, frame->ch_layout.nb_channels);
+    } else {
+      av_channel_layout_copy(&in_layout, &frame->ch_layout);
+    }
+    av_channel_layout_default(&out_layout, out_channels);
+    int res = swr_alloc_set_opts2(&c->swr, &out_layout, AV_SAMPLE_FMT_FLT, out_rate, &in_layout, frame->format,
+                                  frame->sample_rate, 0, NULL);
+    av_channel_layout_uninit(&in_layout);
+    av_channel_layout_uninit(&out_layout);
+    if (res < 0 || swr_init(c->swr) < 0) {
+      swr_free(&c->swr);
+      return 0;
+    }
+    c->swr_in_rate = frame->sample_rate;
+    c->swr_in_format = frame->format;
+    c->swr_out_rate = out_rate;
+    c->swr_out_channels = out_channels;
+  }
+  int max_out = swr_get_out_samples(c->swr, frame->nb_samples);
+  if (max_out <= 0) {
+    return 0;
+  }
+  float* out = audioconvert_grow(&c->out, &c->out_len, max_out * out_channels);
+  int num = swr_convert(c->swr, (uint8_t**)&out, max_out, (const uint8_t**)frame->extended_data, frame->nb_samples);
+  return num > 0 ? num : 0;
+}
+
+int audioconvert_frame(AudioConvert* c, const AVFrame* frame, int out_rate, int out_channels, const float** out) {
+  assert(out_channels == 1 || out_channels == 2);
+  int num = 0;
+  if (frame->sample_rate == out_rate && c->swr == NULL && audioconvert_direct(c, frame, out_channels)) {
+    num = frame->nb_samples;
+  } else {
+    num = audioconvert_resample(c, frame, out_rate, out_channels);
+  }
+  *out = c->out;
+  return num;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// converts decoded audio frames to interleaved float for the output device. same-rate frames in u8/s16/s32/flt/dbl
+// (packed or planar) go through SSE2 kernels that convert the samples and downmix up to 7.1 to stereo or mono in one
+// pass, anything else (other rates, formats or layouts) is handed to swresample
+
+typedef struct AudioConvert AudioConvert;
+
+AudioConvert* audioconvert_create(void);
+void audioconvert_free(AudioConvert* c);
+// drops whatever the resampler has buffered, call after seeking
+void audioconvert_reset(AudioConvert* c);
+
+struct AVFrame;
+// converts frame to interleaved float at out_rate with out_channels (1 or 2). returns the number of frames in *out,
+// which stays valid until the next call
+int audioconvert_frame(AudioConvert* c, const struct AVFrame* frame, int out_rate, int out_channels, const float** out);
@@ -0,0 +1,134 @@
+#include "file_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <Windows.h>
+#define filecache_mkdir(path) _mkdir(path)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define filecache_mkdir(path) mkdir(path, 0755)
+#endif
+
+bool filecache_fingerprint(const char* path, FileFingerprint* fp) {
+#ifdef _WIN32
+  struct _stat64 st;
+  if (_stat64(path, &st) != 0) {
+    return false;
+  }
+#else
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return false;
+  }
+#endif
+  *fp = (FileFingerprint){.size = (int64_t)st.st_size, .mtime = (int64_t)st.st_mtime};
+  return true;
+}
+
+// 64 bit FNV-1a
+uint64_t filecache_hash(const void* data, size_t len, uint64_t seed) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint64_t h = seed ? seed : 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < len; i++) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+#define FILECACHE_MAX_BASE (1024)
+
+const char* filecache_dir(void) {
+  static char dir[FILECACHE_MAX_BASE + sizeof("/cache")]; // the base directory always fits with the suffix after it
+  if (dir[0] != '\0') {
+    return dir;
+  }
+  char base[FILECACHE_MAX_BASE];
+#ifdef _WIN32
+  const char* appdata = getenv("LOCALAPPDATA");
+  snprintf(base, sizeof(base), "%s\\filmsaw", appdata ? appdata : ".");
+  filecache_mkdir(base);
+  snprintf(dir, sizeof(dir), "%s\\cache", base);
+#else
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  if (xdg) {
+    snprintf(base, sizeof(base), "%s/filmsaw", xdg);
+  } else {
+    snprintf(base, sizeof(base), "%s/.cache", home ? home : ".");
+    filecache_mkdir(base);
+    snprintf(base, sizeof(base), "%s/.cache/filmsaw", home ? home : ".");
+  }
+  filecache_mkdir(base);
+  snprintf(dir, sizeof(dir), "%s/cache", base);
+#endif
+  filecache_mkdir(dir);
+  return dir;
+}
+
+bool filecache_path(const char* path, const char* ext, char* out, int outlen) {
+  uint64_t h = filecache_hash(path, strlen(path), 0);
+  int len = snprintf(out, outlen, "%s/%016llx.%s", filecache_dir(), (unsigned long long)h, ext);
+  return len > 0 && len < outlen;
+}
+
+bool filecache_map(const char* path, size_t size, FileMap* m) {
+  *m = (FileMap){0};
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER filesize;
+  if (size == 0 && GetFileSizeEx(file, &filesize)) {
+    size = (size_t)filesize.QuadPart;
+  }
+  HANDLE mapping = size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)size) : NULL;
+  if (data == NULL) {
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return false;
+  }
+  m->file = file;
+  m->mapping = mapping;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (size == 0 && fstat(fd, &st) == 0) {
+    size = (size_t)st.st_size;
+  }
+  void* data = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+#endif
+  m->data = (uint8_t*)data;
+  m->size = size;
+  return true;
+}
+
+void filecache_unmap(FileMap* m) {
+  if (m->data) {
+#ifdef _WIN32
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+    CloseHandle(m->file);
+#else
+    munmap(m->data, m->size);
+#endif
+  }
+  *m = (FileMap){0};
+}
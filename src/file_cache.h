@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// identifies a version of a file on disk, cached data is only valid while this matches
+typedef struct {
+  int64_t size, mtime;
+} FileFingerprint;
+
+bool filecache_fingerprint(const char* path, FileFingerprint* fp);
+uint64_t filecache_hash(const void* data, size_t len, uint64_t seed);
+
+// the directory holding all cached data, created on first use. call this once from the main thread before any
+// worker threads use the cache
+const char* filecache_dir(void);
+// builds the path of the cache file for 'path' with the extension 'ext', creating the cache directory if required
+bool filecache_path(const char* path, const char* ext, char* out, int outlen);
+
+// a read-only memory mapping of a cache file
+typedef struct {
+  uint8_t* data;
+  size_t size;
+#ifdef _WIN32
+  void *file, *mapping;
+#endif
+} FileMap;
+// maps the first 'size' bytes of the file at 'path', or all of it if 'size' is 0
+bool filecache_map(const char* path, size_t size, FileMap* m);
+void filecache_unmap(FileMap* m);
@@ -0,0 +1,175 @@
+#include "frame_cache.h"
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <stdlib.h>
+
+#define FRAMECACHE_BUCKETS (4096)
+
+typedef struct FrameCacheEntry {
+  uint64_t file;
+  int64_t pts;
+  size_t bytes;
+  AVFrame* frame;
+  struct FrameCacheEntry* next_bucket;
+  struct FrameCacheEntry *lru_prev, *lru_next; // lru_prev is more recently used
+} FrameCacheEntry;
+
+typedef struct {
+  bool init;
+  thread_mutex_t mtx;
+  FrameCacheEntry* buckets[FRAMECACHE_BUCKETS];
+  FrameCacheEntry *lru_head, *lru_tail;
+  FrameCacheStats stats;
+} FrameCache;
+static FrameCache _framecache;
+
+static uint32_t framecache_bucket(uint64_t file, int64_t pts) {
+  uint64_t h = file ^ ((uint64_t)pts * 0x9e3779b97f4a7c15ull);
+  return (uint32_t)(h ^ (h >> 32)) % FRAMECACHE_BUCKETS;
+}
+
+static void framecache_unlink(FrameCache* c, FrameCacheEntry* e) {
+  if (e->lru_prev) {
+    e->lru_prev->lru_next = e->lru_next;
+  } else {
+    c->lru_head = e->lru_next;
+  }
+  if (e->lru_next) {
+    e->lru_next->lru_prev = e->lru_prev;
+  } else {
+    c->lru_tail = e->lru_prev;
+  }
+  e->lru_prev = e->lru_next = NULL;
+}
+
+static void framecache_pushfront(FrameCache* c, FrameCacheEntry* e) {
+  e->lru_prev = NULL;
+  e->lru_next = c->lru_head;
+  if (c->lru_head) {
+    c->lru_head->lru_prev = e;
+  }
+  c->lru_head = e;
+  if (c->lru_tail == NULL) {
+    c->lru_tail = e;
+  }
+}
+
+static void framecache_remove(FrameCache* c, FrameCacheEntry* e) {
+  FrameCacheEntry** link = &c->buckets[framecache_bucket(e->file, e->pts)];
+  while (*link != e) {
+    link = &(*link)->next_bucket;
+  }
+  *link = e->next_bucket;
+  framecache_unlink(c, e);
+  c->stats.bytes -= e->bytes;
+  c->stats.num_frames--;
+  av_frame_free(&e->frame);
+  free(e);
+}
+
+static void framecache_evict(FrameCache* c) {
+  while (c->stats.bytes > c->stats.budget && c->lru_tail) {
+    framecache_remove(c, c->lru_tail);
+    c->stats.evictions++;
+  }
+}
+
+void framecache_init(size_t budget_bytes) {
+  FrameCache* c = &_framecache;
+  assert(!c->init);
+  *c = (FrameCache){.init = true, .stats.budget = budget_bytes};
+  thread_mutex_init(&c->mtx);
+}
+
+void framecache_shutdown(void) {
+  FrameCache* c = &_framecache;
+  if (!c->init) {
+    return;
+  }
+  while (c->lru_tail) {
+    framecache_remove(c, c->lru_tail);
+  }
+  thread_mutex_term(&c->mtx);
+  c->init = false;
+}
+
+void framecache_setbudget(size_t budget_bytes) {
+  FrameCache* c = &_framecache;
+  thread_mutex_lock(&c->mtx);
+  c->stats.budget = budget_bytes;
+  framecache_evict(c);
+  thread_mutex_unlock(&c->mtx);
+}
+
+FrameCacheStats framecache_stats(void) {
+  FrameCache* c = &_framecache;
+  thread_mutex_lock(&c->mtx);
+  FrameCacheStats stats = c->stats;
+  thread_mutex_unlock(&c->mtx);
+  return stats;
+}
+
+static FrameCacheEntry* framecache_find(FrameCache* c, uint64_t file, int64_t pts) {
+  for (FrameCacheEntry* e = c->buckets[framecache_bucket(file, pts)]; e; e = e->next_bucket) {
+    if (e->file == file && e->pts == pts) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+void framecache_put(uint64_t file, int64_t pts, const AVFrame* frame) {
+  FrameCache* c = &_framecache;
+  if (!c->init) {
+    return;
+  }
+  int size = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+  if (size <= 0 || (size_t)size > c->stats.budget) {
+    return;
+  }
+  thread_mutex_lock(&c->mtx);
+  FrameCacheEntry* e = framecache_find(c, file, pts);
+  if (e) {
+    framecache_unlink(c, e);
+    framecache_pushfront(c, e);
+    thread_mutex_unlock(&c->mtx);
+    return;
+  }
+  e = (FrameCacheEntry*)calloc(1, sizeof(FrameCacheEntry));
+  assert(e);
+  // a reference is enough to keep the decoder's planes alive, no need to copy them
+  e->frame = av_frame_alloc();
+  av_frame_ref(e->frame, frame);
+  e->file = file;
+  e->pts = pts;
+  e->bytes = (size_t)size;
+  uint32_t bucket = framecache_bucket(file, pts);
+  e->next_bucket = c->buckets[bucket];
+  c->buckets[bucket] = e;
+  framecache_pushfront(c, e);
+  c->stats.bytes += e->bytes;
+  c->stats.num_frames++;
+  framecache_evict(c);
+  thread_mutex_unlock(&c->mtx);
+}
+
+bool framecache_get(uint64_t file, int64_t pts, AVFrame* frame) {
+  FrameCache* c = &_framecache;
+  if (!c->init) {
+    return false;
+  }
+  thread_mutex_lock(&c->mtx);
+  FrameCacheEntry* e = framecache_find(c, file, pts);
+  if (e) {
+    framecache_unlink(c, e);
+    framecache_pushfront(c, e);
+    av_frame_ref(frame, e->frame);
+    c->stats.hits++;
+  } else {
+    c->stats.misses++;
+  }
+  thread_mutex_unlock(&c->mtx);
+  return e != NULL;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// LRU cache of decoded frames in their native pixel format, shared by all videos
+
+#define FRAMECACHE_DEFAULT_BUDGET (512ull * 1024ull * 1024ull)
+
+typedef struct {
+  int64_t hits, misses, evictions;
+  size_t bytes, budget;
+  int num_frames;
+} FrameCacheStats;
+
+struct AVFrame;
+
+void framecache_init(size_t budget_bytes);
+void framecache_shutdown(void);
+void framecache_setbudget(size_t budget_bytes);
+FrameCacheStats framecache_stats(void);
+
+// adds a reference to the frame's planes. 'file' identifies the source, 'pts' is in the stream time base
+void framecache_put(uint64_t file, int64_t pts, const struct AVFrame* frame);
+// on a hit 'frame' is set to a reference to the cached planes, the caller must unref it
+bool framecache_get(uint64_t file, int64_t pts, struct AVFrame* frame);
@@ -14,11 +14,19 @@
 #include <memory.h>
 #include <dirent.h>
 #include <sokol/sokol_audio.h>
+#include <sokol/sokol_time.h>
 #include "video_clips.h"
+#include "thumbnails.h"
+#include "media_cache.h"
+#include "frame_cache.h"
+#include "yuv_convert.h"
+#include "audio.h"
+#include "waveform.h"
 #include <portable_file_dialogs.h>
 #include <thread/thread.h>
 
 static void app_gcvideos(void);
+static void app_dropthumbnails(const VideoClips* dropped);
 
 enum IconType {
   IconType_Pause = 0,
@@ -48,13 +56,13 @@ void undobuffer_push(UndoBuffer* buffer, const VideoClips* clips) {
   }
   buffer->tail++;
   VideoClips* undostate = &buffer->states[buffer->tail % MAX_UNDO_BUFFER];
-  if (undostate->clips) {
-    free(undostate->clips);
-  }
+  VideoClips dropped = *undostate;
   buffer->pos = buffer->tail;
   *undostate = (VideoClips){.clips = (VideoClip*)malloc(clips->num * sizeof(VideoClip)), .num = clips->num};
   assert(undostate->clips);
   memcpy(undostate->clips, clips->clips, sizeof(VideoClip) * clips->num);
+  app_dropthumbnails(&dropped);
+  free(dropped.clips);
 
   app_gcvideos();
 }
@@ -95,6 +103,7 @@ void undobuffer_redo(UndoBuffer* buffer, VideoClips* clips) {
 typedef struct {
   bool is_dir;
   sg_image thumbnail;
+  ThumbnailId thumbnail_req;
   int thumbnail_width, thumbnail_height;
   char filename[PATH_MAX];
   double video_total_secs;
@@ -118,6 +127,7 @@ void videosources_opendir(VideoSources* s, const char* path) {
     if (s->sources[i].thumbnail.id) {
       sg_destroy_image(s->sources[i].thumbnail);
     }
+    thumbnails_cancel(s->sources[i].thumbnail_req);
   }
   s->num = 0;
   // open the directory and list the files
@@ -130,9 +140,7 @@ void videosources_opendir(VideoSources* s, const char* path) {
     if (ent->d_type != DT_DIR && ent->d_type != DT_REG) {
       continue; // only look at files and directories
     }
-    sg_image thumbnail = (sg_image){0};
-    int thumbnail_width = 100, thumbnail_height = 100;
-    double vid_total_secs = 0.0;
+    ThumbnailId thumbnail_req = (ThumbnailId){0};
     if (ent->d_type == DT_REG) {
       char* dot = strrchr(ent->d_name, '.');
       if (dot == NULL) {
@@ -148,16 +156,10 @@ void videosources_opendir(VideoSources* s, const char* path) {
       if (!ok_format) {
         continue;
       }
+      // the thumbnail and duration arrive later from the thumbnail workers
       char fullpath[PATH_MAX];
       snprintf(fullpath, PATH_MAX, "%s/%s", path, ent->d_name);
-      VideoOpenRes res = video_open(fullpath, &(VideoOpenParams){.disable_audio = true});
-      if (res.err) {
-        DebugLog("failed to open %s: %s", fullpath, res.err);
-        continue;
-      }
-      thumbnail = video_make_thumbnail(res.vid, 0.0, &thumbnail_width, &thumbnail_height);
-      vid_total_secs = video_total_secs(res.vid);
-      video_close(res.vid);
+      thumbnail_req = thumbnails_request(fullpath, 0.0, 100, 100, 0);
     } else {
       if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
         continue;
@@ -171,26 +173,37 @@ void videosources_opendir(VideoSources* s, const char* path) {
     }
     VideoSource* source = &s->sources[s->num++];
     *source = (VideoSource){.is_dir = ent->d_type == DT_DIR,
-                            .thumbnail = thumbnail,
-                            .thumbnail_width = thumbnail_width,
-                            .thumbnail_height = thumbnail_height,
-                            .video_total_secs = vid_total_secs};
+                            .thumbnail_req = thumbnail_req,
+                            .thumbnail_width = 100,
+                            .thumbnail_height = 100};
     snprintf(source->filename, PATH_MAX, "%s", ent->d_name);
   }
   snprintf(s->filepath, PATH_MAX, "%s", path);
   closedir(dir);
 }
 
+#define APP_MAX_CURSOR_OPENS (16)
+typedef struct {
+  VideoCursorOpen* op;
+  VideoId vid; // the video the run shares until its cursor is open
+  int track;
+  double runstart;
+} AppCursorOpen;
+
 typedef struct MovieMaker {
   FONScontext* font_ctx;
   int font_sans, font_mono, font_mono_bold;
   UI* ui;
   bool paused;
+  double shuttle;  // playback speed while not paused, negative plays in reverse
+  double stepsecs; // frame length of the shown clip, for stepping a frame at a time
+  int scrubslogged; // scrub count of the shown clip at the last latency report
 
   UndoBuffer undo;
 
   VideoClips clips;
   double trackpos, tracklen;
+  double audioclock; // audio_clock_secs() at the last frame, playback advances by how much audio was played since
   bool didseektrack;
 
   int selclipidx, selmenuidx;
@@ -212,8 +225,12 @@ typedef struct MovieMaker {
   Rect iconrects[IconType_Count];
   Rect iconrectshflipped[IconType_Count];
 
+  // decode cursors being opened for runs that an edit separated from others on the same video
+  AppCursorOpen cursoropens[APP_MAX_CURSOR_OPENS];
+  int num_cursoropens;
+
   thread_mutex_t aud_thread_mtx;
-  VideoId curaud_video;
+  VideoPreviewRes previewres;
 } MovieMaker;
 MovieMaker state;
 
@@ -231,25 +248,95 @@ static int round_pow2(float v) {
 
 int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, int dataSize, int freeData);
 
-static void app_audio_callback(float* buffer, int num_frames, int num_channels) {
-  MovieMaker* m = &state;
-  thread_mutex_lock(&m->aud_thread_mtx);
-  if (m->curaud_video.id) {
-    video_getaudio_underlock(m->curaud_video, buffer, num_frames, num_channels, saudio_sample_rate());
-  } else {
-    for (int i = 0, j = 0; i < num_frames; i++) {
-      buffer[j++] = 0.0f;
-      buffer[j++] = 0.0f;
+// hands finished thumbnails to every clip waiting on them, including the copies held by the undo buffer
+static void app_resolvethumbnails(MovieMaker* m) {
+  for (int i = -1; i < MAX_UNDO_BUFFER; i++) {
+    VideoClips* clips = i == -1 ? &m->clips : &m->undo.states[i];
+    for (int j = 0; j < clips->num; j++) {
+      ThumbnailId req = clips->clips[j].thumbnail_req;
+      sg_image thumbnail;
+      int width = 0, height = 0;
+      if (req.id == 0 || !thumbnails_take(req, &thumbnail, &width, &height, NULL)) {
+        continue;
+      }
+      for (int k = -1; k < MAX_UNDO_BUFFER; k++) {
+        VideoClips* other = k == -1 ? &m->clips : &m->undo.states[k];
+        for (int l = 0; l < other->num; l++) {
+          VideoClip* clip = &other->clips[l];
+          if (clip->thumbnail_req.id == req.id) {
+            clip->thumbnail = thumbnail;
+            clip->thumbnail_width = width;
+            clip->thumbnail_height = height;
+            clip->thumbnail_req = (ThumbnailId){0};
+          }
+        }
+      }
     }
   }
-  thread_mutex_unlock(&m->aud_thread_mtx);
+}
+
+// starts opening a decode cursor for every run that shares its video with another run, after an edit that can move
+// clips apart. they keep playing from the shared one until app_resolvecursors hands them their own
+static void app_splitcursors(MovieMaker* m) {
+  int runs[APP_MAX_CURSOR_OPENS];
+  int num = videoclips_sharedruns(&m->clips, runs, APP_MAX_CURSOR_OPENS);
+  for (int i = 0; i < num && m->num_cursoropens < APP_MAX_CURSOR_OPENS; i++) {
+    const VideoClip* clip = &m->clips.clips[runs[i]];
+    double runstart, runend;
+    videoclips_runextent(&m->clips, clip, &runstart, &runend);
+    bool pending = false;
+    for (int j = 0; j < m->num_cursoropens; j++) {
+      const AppCursorOpen* o = &m->cursoropens[j];
+      pending |= o->vid.id == clip->vid.id && o->track == clip->track && fabs(o->runstart - runstart) < 1e-6;
+    }
+    if (!pending) {
+      m->cursoropens[m->num_cursoropens++] = (AppCursorOpen){
+          .op = video_opencursor_async(clip->vid), .vid = clip->vid, .track = clip->track, .runstart = runstart};
+    }
+  }
+}
+
+// moves runs over to the cursors that have finished opening, in the clips and in every undo state that has the run.
+// a cursor whose run has gone or is the only one left on its video is closed again
+static void app_resolvecursors(MovieMaker* m) {
+  for (int i = 0; i < m->num_cursoropens;) {
+    AppCursorOpen* o = &m->cursoropens[i];
+    VideoOpenRes res;
+    if (!video_opencursor_ready(o->op, &res)) {
+      i++;
+      continue;
+    }
+    if (res.err) {
+      DebugLog("failed to open a decode cursor: %s\n", res.err);
+    } else {
+      int moved = 0;
+      for (int k = -1; k < MAX_UNDO_BUFFER; k++) {
+        VideoClips* clips = k == -1 ? &m->clips : &m->undo.states[k];
+        moved += videoclips_moverun(clips, o->vid, o->track, o->runstart, res.vid);
+      }
+      if (moved == 0) {
+        video_close(res.vid);
+      }
+    }
+    *o = m->cursoropens[--m->num_cursoropens];
+  }
+}
+
+static void app_cancelcursors(MovieMaker* m) {
+  for (int i = 0; i < m->num_cursoropens; i++) {
+    video_opencursor_cancel(m->cursoropens[i].op);
+  }
+  m->num_cursoropens = 0;
 }
 
 static void app_gcvideos(void) {
   MovieMaker* m = &state;
+  // the audio thread lets go of every video before any of them are closed. closing joins the decode threads, which
+  // take aud_thread_mtx themselves, so that has to happen after it's unlocked
   thread_mutex_lock(&m->aud_thread_mtx);
+  audio_setsources_underlock(NULL, 0);
+  thread_mutex_unlock(&m->aud_thread_mtx);
 
-  m->curaud_video = (VideoId){0};
   video_gc_clearmarks();
   for (int i = 0; i < m->clips.num; i++) {
     video_gc_mark(m->clips.clips[i].vid);
@@ -261,19 +348,42 @@ static void app_gcvideos(void) {
     }
   }
   video_gc_sweep();
+}
 
-  thread_mutex_unlock(&m->aud_thread_mtx);
+// cancels the thumbnail requests of clips that have gone from the timeline and the undo buffer, nothing would ever take
+// them otherwise and each one would keep its slot in the request table
+static void app_dropthumbnails(const VideoClips* dropped) {
+  MovieMaker* m = &state;
+  for (int i = 0; i < dropped->num; i++) {
+    ThumbnailId req = dropped->clips[i].thumbnail_req;
+    bool wanted = false;
+    for (int j = -1; j < MAX_UNDO_BUFFER && req.id && !wanted; j++) {
+      const VideoClips* clips = j == -1 ? &m->clips : &m->undo.states[j];
+      for (int k = 0; k < clips->num && !wanted; k++) {
+        wanted = clips->clips[k].thumbnail_req.id == req.id;
+      }
+    }
+    if (req.id && !wanted) {
+      thumbnails_cancel(req);
+    }
+  }
 }
 
 static void app_init(void) {
   sg_setup(&(sg_desc){.context = sapp_sgcontext()});
   sgl_setup(&(sgl_desc_t){0});
   videopool_init();
-  saudio_setup(&(saudio_desc){.num_channels = 2, .stream_cb = app_audio_callback});
+  stm_setup();
+  saudio_setup(&(saudio_desc){.num_channels = 2, .stream_cb = audio_callback});
 
   MovieMaker* m = &state;
+  m->shuttle = 1.0;
 
   thread_mutex_init(&m->aud_thread_mtx);
+  audio_init(saudio_sample_rate(), saudio_channels(), &m->aud_thread_mtx);
+  mediacache_init(MEDIACACHE_DEFAULT_CAP);
+  yuvconvert_init(3);
+  thumbnails_init(4);
 
   const int atlas_dim = round_pow2(512.0f * sapp_dpi_scale());
   m->font_ctx = sfons_create(atlas_dim, atlas_dim, FONS_ZERO_TOPLEFT);
@@ -318,17 +428,17 @@ static void app_sliceclip(MovieMaker* m) {
   if (clip->pos > pos_secs || pos_secs > (clip->pos + clip->clipend - clip->clipstart)) {
     return;
   }
-  int thumbnail_width = 100, thumbnail_height = 100;
-  sg_image thumbnail =
-      video_make_thumbnail(clip->vid, (pos_secs - clip->pos) + clip->clipstart, &thumbnail_width, &thumbnail_height);
+  ThumbnailId thumbnail_req =
+      thumbnails_request(video_filepath(clip->vid), (pos_secs - clip->pos) + clip->clipstart, 100, 100, 1);
   videoclips_push(&m->clips, (VideoClip){.pos = pos_secs,
                                          .track = clip->track,
                                          .clipstart = (pos_secs - clip->pos) + clip->clipstart,
                                          .clipend = clip->clipend,
+                                         .gain_db = clip->gain_db,
                                          .vid = clip->vid,
-                                         .thumbnail = thumbnail,
-                                         .thumbnail_width = thumbnail_width,
-                                         .thumbnail_height = thumbnail_height});
+                                         .thumbnail_req = thumbnail_req,
+                                         .thumbnail_width = 100,
+                                         .thumbnail_height = 100});
   clip->clipend = pos_secs - clip->pos + clip->clipstart;
   undobuffer_push(&m->undo, &m->clips);
 }
@@ -337,10 +447,74 @@ static void app_deleteclip(MovieMaker* m) {
   if (m->selclipidx == -1) {
     return;
   }
+  VideoClip deleted = m->clips.clips[m->selclipidx];
   m->clips.clips[m->selclipidx] = m->clips.clips[m->clips.num - 1];
   m->clips.num--;
   m->selclipidx = -1;
+  app_splitcursors(m); // deleting a slice from the middle of a run leaves two runs on its video
   undobuffer_push(&m->undo, &m->clips);
+  app_dropthumbnails(&(VideoClips){.clips = &deleted, .num = 1});
+}
+
+#define MAX_CLIP_GAIN_DB (24.0f)
+
+static void app_clipgain(MovieMaker* m, float delta_db) {
+  if (m->selclipidx == -1) {
+    return;
+  }
+  VideoClip* clip = &m->clips.clips[m->selclipidx];
+  clip->gain_db = fminf(fmaxf(clip->gain_db + delta_db, -MAX_CLIP_GAIN_DB), MAX_CLIP_GAIN_DB);
+  undobuffer_push(&m->undo, &m->clips);
+}
+
+static void app_clipgainup(MovieMaker* m) {
+  app_clipgain(m, 1.0f);
+}
+
+static void app_clipgaindown(MovieMaker* m) {
+  app_clipgain(m, -1.0f);
+}
+
+static void app_playpause(MovieMaker* m) {
+  m->paused = !m->paused;
+  m->shuttle = 1.0;
+}
+
+// J/L start playing at 1x in their direction and double the speed on every press after, K stops
+static void app_shuttle(MovieMaker* m, double dir) {
+  if (m->paused || m->shuttle * dir < 0.0) {
+    m->shuttle = dir;
+  } else {
+    m->shuttle = ui_clampd(m->shuttle * 2.0, -VIDEO_SHUTTLE_MAX_SPEED, VIDEO_SHUTTLE_MAX_SPEED);
+  }
+  m->paused = false;
+}
+
+static void app_shuttlereverse(MovieMaker* m) {
+  app_shuttle(m, -1.0);
+}
+
+static void app_shuttleforward(MovieMaker* m) {
+  app_shuttle(m, 1.0);
+}
+
+static void app_shuttlestop(MovieMaker* m) {
+  m->paused = true;
+  m->shuttle = 1.0;
+}
+
+static void app_stepframe(MovieMaker* m, double frames) {
+  m->paused = true;
+  m->trackpos = ui_clampd(m->trackpos + frames * (m->stepsecs > 0.0 ? m->stepsecs : 1.0 / 30.0), 0.0, m->tracklen);
+  m->didseektrack = true;
+}
+
+static void app_stepback(MovieMaker* m) {
+  app_stepframe(m, -1.0);
+}
+
+static void app_stepforward(MovieMaker* m) {
+  app_stepframe(m, 1.0);
 }
 
 static void app_redo(MovieMaker* m) {
@@ -355,13 +529,17 @@ static void app_openproject(MovieMaker* m) {
   char pathbuf[PATH_MAX];
   const char* filters = "*.json";
   if (pfd_open_dialog("Open Project", &filters, 1, pathbuf, PATH_MAX)) {
+    app_cancelcursors(m);
     undobuffer_clear(&m->undo);
     videoclips_free(&m->clips);
     app_gcvideos();
     m->trackpos = 0.0;
     m->trackzoom = 800.0f / 32.0f;
     m->trackoffset = 16.0f * 0.5f;
-    videoclips_load(pathbuf, &m->clips, &(VideoOpenParams){0});
+    videoclips_load(pathbuf, &m->clips,
+                    &(VideoOpenParams){.async_decode = true,
+                                       .pcm_cache_rate = saudio_sample_rate(),
+                                       .pcm_cache_channels = saudio_channels()});
   }
 }
 
@@ -380,6 +558,7 @@ static void app_exportproject(MovieMaker* m) {
 
 static void app_newproject(MovieMaker* m) {
   (void)m;
+  app_cancelcursors(m);
   undobuffer_clear(&m->undo);
   videoclips_free(&m->clips);
   app_gcvideos();
@@ -400,6 +579,22 @@ static void app_pasteclip(MovieMaker* m) {
   (void)m;
 }
 
+static void app_previewfit(MovieMaker* m) {
+  m->previewres = VideoPreviewRes_Fit;
+}
+
+static void app_previewfull(MovieMaker* m) {
+  m->previewres = VideoPreviewRes_Full;
+}
+
+static void app_previewhalf(MovieMaker* m) {
+  m->previewres = VideoPreviewRes_Half;
+}
+
+static void app_previewquarter(MovieMaker* m) {
+  m->previewres = VideoPreviewRes_Quarter;
+}
+
 static void app_exit(MovieMaker* m) {
   (void)m;
   sapp_request_quit();
@@ -421,6 +616,30 @@ static void app_event(const sapp_event* ev) {
     case SAPP_KEYCODE_DELETE:
       app_deleteclip(m);
       break;
+    case SAPP_KEYCODE_SPACE:
+      app_playpause(m);
+      break;
+    case SAPP_KEYCODE_J:
+      app_shuttlereverse(m);
+      break;
+    case SAPP_KEYCODE_K:
+      app_shuttlestop(m);
+      break;
+    case SAPP_KEYCODE_L:
+      app_shuttleforward(m);
+      break;
+    case SAPP_KEYCODE_LEFT:
+      app_stepback(m);
+      break;
+    case SAPP_KEYCODE_RIGHT:
+      app_stepforward(m);
+      break;
+    case SAPP_KEYCODE_EQUAL:
+      app_clipgainup(m);
+      break;
+    case SAPP_KEYCODE_MINUS:
+      app_clipgaindown(m);
+      break;
     case SAPP_KEYCODE_Z:
       if (ev->modifiers & SAPP_MODIFIER_CTRL) {
         if (ev->modifiers & SAPP_MODIFIER_SHIFT) {
@@ -485,6 +704,7 @@ BoxStyle track_style = {.bg_color = {51, 77, 128, 255}, .border_radius = 1.0f};
 BoxStyle track_style_shadow = {.bg_color = {0, 0, 0, 255}, .border_radius = 1.0f, .blur_amount = 0.1f};
 BoxStyle track_style_sel = {.bg_color = {77, 100, 144, 255}, .border_radius = 1.0f};
 Color trackmarker_col = {66, 109, 174, 255};
+BoxStyle thumbnail_placeholder = {.bg_color = {40, 40, 40, 255}, .border_radius = 0.2f};
 
 typedef void (*MenuAction)(MovieMaker* m);
 typedef struct {
@@ -507,7 +727,7 @@ static MenuAction app_menu(MovieMaker* m, Rect menu) {
                                {.name = "Export Video", .shortcut = "Ctrl E", .action = app_exportproject},
                                {.name = "Exit", .action = app_exit}}},
                     {.name = "Edit",
-                     .numitems = 7,
+                     .numitems = 9,
                      .items =
                          {
                              {.name = "Undo", .shortcut = "Ctrl Z", .action = app_undo},
@@ -517,12 +737,28 @@ static MenuAction app_menu(MovieMaker* m, Rect menu) {
                              {.name = "Paste Clip", .shortcut = "Ctrl V", .action = app_pasteclip},
                              {.name = "Slice Clip", .shortcut = "X", .action = app_sliceclip},
                              {.name = "Delete Clip", .shortcut = "Delete", .action = app_deleteclip},
+                             {.name = "Clip Gain +1dB", .shortcut = "=", .action = app_clipgainup},
+                             {.name = "Clip Gain -1dB", .shortcut = "-", .action = app_clipgaindown},
                          }},
+                    {.name = "Play",
+                     .numitems = 6,
+                     .items = {{.name = "Play / Pause", .shortcut = "Space", .action = app_playpause},
+                               {.name = "Shuttle Reverse", .shortcut = "J", .action = app_shuttlereverse},
+                               {.name = "Stop", .shortcut = "K", .action = app_shuttlestop},
+                               {.name = "Shuttle Forward", .shortcut = "L", .action = app_shuttleforward},
+                               {.name = "Previous Frame", .shortcut = "Left", .action = app_stepback},
+                               {.name = "Next Frame", .shortcut = "Right", .action = app_stepforward}}},
+                    {.name = "View",
+                     .numitems = 4,
+                     .items = {{.name = "Preview Fit To Panel", .action = app_previewfit},
+                               {.name = "Preview Full Res", .action = app_previewfull},
+                               {.name = "Preview Half Res", .action = app_previewhalf},
+                               {.name = "Preview Quarter Res", .action = app_previewquarter}}},
                     {.name = "Help", .numitems = 1, .items = {{.name = "About"}}}};
   ui_draw_box(m->ui, rect_inset_bottom(menu, 2.0f), &(BoxStyle){.bg_color = {29, 29, 29, 255}});
   rect_cut_left(&menu, 5.0f);
   MenuAction action = NULL;
-  for (int i = 0; i < 3; i++) {
+  for (int i = 0; i < _countof(bars); i++) {
     MenuBar* bar = &bars[i];
     float w =
         ui_measure_text_wh(m->ui, bar->name, NULL, &(DrawTextOptions){.font_size = 14.0f}, 100.0f, NULL, NULL) + 14.0f;
@@ -583,6 +819,51 @@ static MenuAction app_menu(MovieMaker* m, Rect menu) {
   return action;
 }
 
+// draws the audio peaks of the part of 'clip' inside 'r', only for the columns between visminx and vismaxx
+static void app_drawwaveform(MovieMaker* m, const VideoClip* clip, Rect r, float visminx, float vismaxx) {
+  const float colw = 2.0f;
+  int num_peaks;
+  double peak_secs;
+  const WaveformPeak* peaks =
+      waveform_level(video_waveform(clip->vid), colw / m->trackzoom, &num_peaks, &peak_secs);
+  if (peaks == NULL) {
+    return;
+  }
+  float minx = fmaxf(r.minx, visminx), maxx = fminf(r.maxx, vismaxx);
+  float mid = (r.miny + r.maxy) * 0.5f, half = rect_height(r) * 0.5f;
+  static Rect peakbars[512], rmsbars[512];
+  int num_bars = 0;
+  for (float x = minx; x < maxx; x += colw) {
+    double t = clip->clipstart + (x - r.minx) / m->trackzoom;
+    int i0 = (int)(t / peak_secs), i1 = (int)((t + colw / m->trackzoom) / peak_secs);
+    i1 = i1 > i0 ? i1 : i0 + 1;
+    i1 = i1 < num_peaks ? i1 : num_peaks;
+    if (i0 < 0 || i0 >= i1) {
+      continue;
+    }
+    int8_t pmin = peaks[i0].min, pmax = peaks[i0].max;
+    uint8_t rms = peaks[i0].rms;
+    for (int i = i0 + 1; i < i1; i++) {
+      pmin = peaks[i].min < pmin ? peaks[i].min : pmin;
+      pmax = peaks[i].max > pmax ? peaks[i].max : pmax;
+      rms = peaks[i].rms > rms ? peaks[i].rms : rms;
+    }
+    float x1 = fminf(x + colw - 0.5f, maxx);
+    float top = mid - (pmax / 127.0f) * half, bottom = mid - (pmin / 127.0f) * half, rmsh = (rms / 255.0f) * half;
+    peakbars[num_bars] = (Rect){x, top, x1, fmaxf(bottom, top + 1.0f)};
+    rmsbars[num_bars] = (Rect){x, mid - rmsh, x1, mid + rmsh};
+    if (++num_bars == 512) {
+      ui_draw_rects(m->ui, color_col(255, 255, 255, 60), peakbars, num_bars);
+      ui_draw_rects(m->ui, color_col(255, 255, 255, 110), rmsbars, num_bars);
+      num_bars = 0;
+    }
+  }
+  if (num_bars > 0) {
+    ui_draw_rects(m->ui, color_col(255, 255, 255, 60), peakbars, num_bars);
+    ui_draw_rects(m->ui, color_col(255, 255, 255, 110), rmsbars, num_bars);
+  }
+}
+
 static void app_trackspanel(MovieMaker* m, Rect trackspanel) {
 
   ui_draw_box(m->ui, trackspanel, &(BoxStyle){.bg_color = track_bg});
@@ -719,6 +1000,7 @@ static void app_trackspanel(MovieMaker* m, Rect trackspanel) {
       m->selclipidx = i;
     } else if (m->selclipidx == i && m->selclipdragstarted) {
       m->selclipdragstarted = false;
+      app_splitcursors(m);
       undobuffer_push(&m->undo, &m->clips);
     }
 
@@ -730,9 +1012,14 @@ static void app_trackspanel(MovieMaker* m, Rect trackspanel) {
       ui_scissor(m->ui, &clipname);
       ui_draw_text(m->ui, clipname, video_filename(clip->vid), NULL, &(DrawTextOptions){.font_size = 14.0f});
       ui_scissor(m->ui, NULL);
-      ui_draw_image(
-          m->ui, rect_fit(rect_inset_left(track, 80.0f), (float)clip->thumbnail_width, (float)clip->thumbnail_height),
-          clip->thumbnail, (Rect){0.0f, 0.0f, 1.0f, 1.0f});
+      app_drawwaveform(m, clip, track, trackspanel.minx, trackspanel.maxx);
+      Rect thumbnailpos =
+          rect_fit(rect_inset_left(track, 80.0f), (float)clip->thumbnail_width, (float)clip->thumbnail_height);
+      if (clip->thumbnail.id) {
+        ui_draw_image(m->ui, thumbnailpos, clip->thumbnail, (Rect){0.0f, 0.0f, 1.0f, 1.0f});
+      } else {
+        ui_draw_box(m->ui, thumbnailpos, &thumbnail_placeholder);
+      }
     }
   }
 
@@ -822,18 +1109,19 @@ static void app_trackspanel(MovieMaker* m, Rect trackspanel) {
         if (m->placevideo) {
           char fullpath[PATH_MAX];
           snprintf(fullpath, PATH_MAX, "%s/%s", m->sources.filepath, m->placevideo->filename);
-          VideoOpenRes res = video_open(fullpath, &(VideoOpenParams){0});
+          VideoOpenRes res = video_open(fullpath, &(VideoOpenParams){.async_decode = true,
+                                                                     .pcm_cache_rate = saudio_sample_rate(),
+                                                                     .pcm_cache_channels = saudio_channels()});
           if (res.err) {
             DebugLog("failed to open video %s: %s\n", fullpath, res.err);
           } else {
-            int thumbnail_width = 100, thumbnail_height = 100;
-            sg_image thumbnail = video_make_thumbnail(res.vid, 0.0, &thumbnail_width, &thumbnail_height);
+            ThumbnailId thumbnail_req = thumbnails_request(fullpath, 0.0, 100, 100, 1);
             videoclips_push(&m->clips, (VideoClip){.vid = res.vid,
                                                    .pos = pos,
-                                                   .clipend = source->video_total_secs,
-                                                   .thumbnail = thumbnail,
-                                                   .thumbnail_width = thumbnail_width,
-                                                   .thumbnail_height = thumbnail_height,
+                                                   .clipend = video_total_secs(res.vid),
+                                                   .thumbnail_req = thumbnail_req,
+                                                   .thumbnail_width = 100,
+                                                   .thumbnail_height = 100,
                                                    .track = trackidx});
             undobuffer_push(&m->undo, &m->clips);
           }
@@ -859,6 +1147,50 @@ static void app_trackspanel(MovieMaker* m, Rect trackspanel) {
   }
 }
 
+// how far ahead of the playhead at 1x the clips it reaches next get their decoders positioned
+#define APP_PREFETCH_SECS (2.0)
+#define APP_PREFETCH_TRACKS (8)
+
+// positions the decoders of the clips the playhead reaches next, so cuts don't wait on a cold seek. on each track the
+// nearest clip starting within APP_PREFETCH_SECS of playback (scaled by the shuttle speed) is prefetched at the point
+// playback enters it: its in-point going forward, its out-point in reverse. the frames decoded for it also go into
+// the frame cache, which keeps the start of the cut warm for scrubbing back to it. clips sharing a decoder with one
+// that's playing are left alone, moving that decoder would stop the clip being played
+static void app_prefetch(MovieMaker* m, const AudioSource* playing, int num_playing, int previewwidth,
+                         int previewheight) {
+  double speed = m->paused ? 0.0 : m->shuttle;
+  double horizon = APP_PREFETCH_SECS * fmax(fabs(speed), 1.0);
+  const VideoClip* next[APP_PREFETCH_TRACKS] = {0};
+  double nextdist[APP_PREFETCH_TRACKS];
+  for (int i = 0; i < m->clips.num; i++) {
+    const VideoClip* clip = &m->clips.clips[i];
+    double start = clip->pos, end = clip->pos + (clip->clipend - clip->clipstart);
+    double dist = speed < 0.0 ? m->trackpos - end : start - m->trackpos;
+    if (clip->track < 0 || clip->track >= APP_PREFETCH_TRACKS || dist <= 0.0 || dist > horizon) {
+      continue;
+    }
+    bool busy = false;
+    for (int j = 0; j < num_playing; j++) {
+      busy |= playing[j].vid.id == clip->vid.id;
+    }
+    if (!busy && (next[clip->track] == NULL || dist < nextdist[clip->track])) {
+      next[clip->track] = clip;
+      nextdist[clip->track] = dist;
+    }
+  }
+  for (int i = 0; i < APP_PREFETCH_TRACKS; i++) {
+    const VideoClip* clip = next[i];
+    for (int j = 0; clip && j < i; j++) {
+      clip = next[j] && next[j]->vid.id == clip->vid.id ? NULL : clip; // one position per decoder
+    }
+    if (clip) {
+      double entry = speed < 0.0 ? clip->clipend - video_frame_secs(clip->vid) : clip->clipstart;
+      video_setpreviewres(clip->vid, m->previewres, previewwidth, previewheight);
+      video_prefetch(clip->vid, entry, speed, &m->aud_thread_mtx);
+    }
+  }
+}
+
 static void app_drawvideo(MovieMaker* m, VideoId vid, Rect videopanel) {
   float vw = (float)video_width(vid), vh = (float)video_height(vid);
   float rw = rect_width(videopanel), rh = rect_height(videopanel);
@@ -912,7 +1244,7 @@ static void app_videopanel(MovieMaker* m, Rect videopanel) {
     case 1:
       r = m->iconrects[m->paused ? IconType_Play : IconType_Pause];
       if (evt & UIEvent_MouseClick) {
-        m->paused = !m->paused;
+        app_playpause(m);
       }
       break;
     case 2:
@@ -967,46 +1299,80 @@ static void app_videopanel(MovieMaker* m, Rect videopanel) {
   // draw video
   {
     ui_draw_box(m->ui, videopanel, &(BoxStyle){.bg_color = {0, 0, 0, 255}});
-    double dt = sapp_frame_duration();
+    // the audio device is the master clock, the display's frame time only stands in when there's no audio device.
+    // a stalled device stalls the playhead too, rather than letting the video run ahead of what's heard
+    double clock = audio_clock_secs();
+    double dt = saudio_isvalid() ? ui_clampd(clock - m->audioclock, 0.0, 0.25) : sapp_frame_duration();
+    m->audioclock = clock;
     if (!m->paused) {
-      m->trackpos = ui_clampd(m->trackpos + dt, 0.0, m->tracklen);
+      m->trackpos = ui_clampd(m->trackpos + dt * m->shuttle, 0.0, m->tracklen);
     }
 
     // find the current top and bottom clip
-    const VideoClip* top = NULL;
-    const VideoClip* bottom = NULL;
-    for (int i = 0; i < m->clips.num; i++) {
+    // every clip under the playhead is decoded so its audio can be mixed, the lowest track is the one shown. the
+    // slices of a run share a decode cursor and only meet at the cut, where the first of them is played
+    const VideoClip* shown = NULL;
+    AudioSource sources[AUDIO_MAX_SOURCES];
+    int num_sources = 0;
+    // only decode + convert as many pixels as the panel can show
+    int previewwidth = (int)(rect_width(videopanel) * sapp_dpi_scale());
+    int previewheight = (int)(rect_height(videopanel) * sapp_dpi_scale());
+    for (int i = 0; i < m->clips.num && num_sources < AUDIO_MAX_SOURCES; i++) {
       const VideoClip* clip = &m->clips.clips[i];
-      if (m->trackpos >= clip->pos && m->trackpos <= clip->pos + (clip->clipend - clip->clipstart)) {
-        if (clip->track == 0 && top == NULL) {
-          top = clip;
-        }
-        if (clip->track == 1 && bottom == NULL) {
-          bottom = clip;
-        }
-        if (top && bottom) {
-          break;
-        }
+      double cliplen = clip->clipend - clip->clipstart;
+      if (m->trackpos < clip->pos || m->trackpos > clip->pos + cliplen) {
+        continue;
+      }
+      bool playing = false;
+      for (int j = 0; j < num_sources; j++) {
+        playing |= sources[j].vid.id == clip->vid.id;
+      }
+      if (playing) {
+        continue;
+      }
+      double clippos = ui_clampd(m->trackpos - clip->pos + clip->clipstart, 0.0, video_total_secs(clip->vid));
+      video_setpreviewres(clip->vid, m->previewres, previewwidth, previewheight);
+      video_setshuttle(clip->vid, m->paused ? 0.0 : m->shuttle);
+      video_nextframe(clip->vid, clippos, &m->aud_thread_mtx);
+      // audio is only heard at 1x, and as scrub grains while paused. it only fades at the ends of a run of slices
+      bool audible = m->paused || m->shuttle == 1.0;
+      double runstart, runend;
+      videoclips_runextent(&m->clips, clip, &runstart, &runend);
+      sources[num_sources++] = (AudioSource){.vid = clip->vid,
+                                             .gain = audible ? powf(10.0f, clip->gain_db / 20.0f) : 0.0f,
+                                             .from_start_secs = m->trackpos - runstart,
+                                             .to_end_secs = runend - m->trackpos};
+      if (shown == NULL || clip->track < shown->track) {
+        shown = clip;
       }
     }
-    if (top) {
-      double clippos = ui_clampd(m->trackpos - top->pos + top->clipstart, 0.0, video_total_secs(top->vid));
-      video_nextframe(top->vid, clippos, &m->aud_thread_mtx);
-      app_drawvideo(m, top->vid, videopanel);
-    } else if (bottom) {
-      double clippos = ui_clampd(m->trackpos - bottom->pos + bottom->clipstart, 0.0, video_total_secs(bottom->vid));
-      video_nextframe(bottom->vid, clippos, &m->aud_thread_mtx);
-      app_drawvideo(m, bottom->vid, videopanel);
+    if (shown) {
+      m->stepsecs = video_frame_secs(shown->vid);
+      app_drawvideo(m, shown->vid, videopanel);
+      VideoStats stats = video_stats(shown->vid);
+      if (stats.scrubs != m->scrubslogged) {
+        m->scrubslogged = stats.scrubs;
+        DebugLog("scrub to photon %.1fms (first image %.1fms, worst %.1fms)\n", stats.scrub_latency_secs * 1000.0,
+                 stats.scrub_preview_secs * 1000.0, stats.scrub_latency_max_secs * 1000.0);
+#ifdef _DEBUG
+        // the cache hit rates are what the cache budgets are sized from
+        FrameCacheStats frames = framecache_stats();
+        DebugLog("frame cache %d frames, %.0f of %.0fMB, %lld hits, %lld misses, %lld evictions\n", frames.num_frames,
+                 frames.bytes / 1048576.0, frames.budget / 1048576.0, (long long)frames.hits,
+                 (long long)frames.misses, (long long)frames.evictions);
+        MediaCacheStats media = mediacache_stats();
+        DebugLog("media cache %d entries, %.0f of %.0fMB, %lld hits, %lld misses, %lld evictions\n", media.num_entries,
+                 media.bytes / 1048576.0, media.cap / 1048576.0, (long long)media.hits, (long long)media.misses,
+                 (long long)media.evictions);
+        AudioStats audio = audio_stats();
+        DebugLog("audio %d underruns, %d frames of silence\n", audio.underruns, audio.underrun_frames);
+#endif
+      }
     }
     thread_mutex_lock(&m->aud_thread_mtx);
-    if (top) {
-      m->curaud_video = top->vid;
-    } else if (bottom) {
-      m->curaud_video = bottom->vid;
-    } else {
-      m->curaud_video = (VideoId){0};
-    }
+    audio_setsources_underlock(sources, num_sources);
     thread_mutex_unlock(&m->aud_thread_mtx);
+    app_prefetch(m, sources, num_sources, previewwidth, previewheight);
   }
 }
 
@@ -1084,10 +1450,19 @@ static void app_sourcepanel(MovieMaker* m, Rect sourcepanel) {
       maxscroll += gridwidth;
       gx = 0;
     }
-    const VideoSource* source = &m->sources.sources[i];
+    VideoSource* source = &m->sources.sources[i];
     float mx = sourcepanel.minx + (gx * gridwidth), my = sourcepanel.miny + (gy * gridwidth) - m->sourcescroll;
     Rect grid = rect_contract((Rect){mx, my, mx + gridwidth, my + gridwidth}, 5.0f);
     UIEvent evt = ui_get_event(m->ui, grid);
+    if (source->thumbnail_req.id) {
+      // visible cells jump the queue, and a cell being dragged goes before them: its drag waits for the duration
+      bool visible = grid.maxy >= sourcepanelscissor.miny && grid.miny <= sourcepanelscissor.maxy;
+      thumbnails_prioritize(source->thumbnail_req, (evt & UIEvent_MouseDrag) ? 2 : (visible ? 1 : 0));
+      if (thumbnails_take(source->thumbnail_req, &source->thumbnail, &source->thumbnail_width,
+                          &source->thumbnail_height, &source->video_total_secs)) {
+        source->thumbnail_req = (ThumbnailId){0};
+      }
+    }
     ui_draw_box(m->ui, grid,
                 evt & UIEvent_MouseHover ? &(BoxStyle){.bg_color = 84, 84, 84, 255, .border_radius = 0.5f}
                                          : &(BoxStyle){.bg_color = 64, 64, 64, 255, .border_radius = 0.5f});
@@ -1098,7 +1473,8 @@ static void app_sourcepanel(MovieMaker* m, Rect sourcepanel) {
       m->sourcescroll = 0.0f;
       m->switch_source_idx = i;
     }
-    if (evt & UIEvent_MouseDrag && !source->is_dir) {
+    // the clip's length comes back with its thumbnail request, the drag only starts once that has finished
+    if (evt & UIEvent_MouseDrag && !source->is_dir && source->video_total_secs > 0.0) {
       m->dragvideo = source;
       m->placevideo = NULL;
       Mouse mouse = ui_mouse(m->ui, (Rect){0});
@@ -1116,6 +1492,9 @@ static void app_sourcepanel(MovieMaker* m, Rect sourcepanel) {
       rect_cut_top(&grid, 15.0f);
       ui_draw_image(m->ui, rect_fit(grid, (float)source->thumbnail_width, (float)source->thumbnail_height),
                     source->thumbnail, (Rect){0.0f, 0.0f, 1.0f, 1.0f});
+    } else if (source->thumbnail_req.id) {
+      rect_cut_top(&grid, 15.0f);
+      ui_draw_box(m->ui, rect_contract(grid, 5.0f), &thumbnail_placeholder);
     }
     gx++;
   }
@@ -1146,6 +1525,8 @@ static void app_frame(void) {
   MovieMaker* m = &state;
 
   ui_frame(m->ui);
+  app_resolvethumbnails(m);
+  app_resolvecursors(m);
   sgl_defaults();
   sgl_matrix_mode_projection();
   sgl_ortho(0.0f, sapp_widthf(), sapp_heightf(), 0.0f, -1.0f, +1.0f);
@@ -1193,7 +1574,13 @@ static void app_frame(void) {
 }
 
 static void app_cleanup(void) {
+  app_cancelcursors(&state);
   saudio_shutdown();
+  audio_shutdown();
+  videopool_shutdown();
+  thumbnails_shutdown();
+  mediacache_shutdown();
+  yuvconvert_shutdown();
 }
 
 sapp_desc sokol_main(int argc, char* argv[]) {
@@ -0,0 +1,298 @@
+#include "media_cache.h"
+#include "file_cache.h"
+#include "video.h"
+#include <libavutil/mem.h>
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEDIACACHE_MAGIC (0x4d435346) // 'FSCM'
+#define MEDIACACHE_VERSION (1)
+
+typedef struct {
+  uint64_t key; // path + thumbnail position + bounding box
+  FileFingerprint fp;
+  uint64_t last_used;
+  uint64_t offset;
+  uint32_t size;
+  int32_t width, height, video_width, video_height;
+  double total_secs;
+} MediaCacheEntry;
+
+typedef struct {
+  uint32_t magic, version;
+  int32_t num;
+  uint64_t clock;
+} MediaCacheHeader;
+
+typedef struct {
+  bool init;
+  thread_mutex_t mtx;
+  char idxpath[1024], packpath[1024];
+  MediaCacheEntry* entries;
+  int num, cap;
+  uint64_t clock, packsize;
+  FileMap map;
+  MediaCacheStats stats;
+} MediaCache;
+static MediaCache _mediacache;
+
+static bool mediacache_map(MediaCache* c) {
+  filecache_unmap(&c->map);
+  return c->packsize > 0 && filecache_map(c->packpath, (size_t)c->packsize, &c->map);
+}
+
+static void mediacache_saveindex(MediaCache* c) {
+  FILE* f = fopen(c->idxpath, "wb");
+  if (f == NULL) {
+    return;
+  }
+  MediaCacheHeader h = {.magic = MEDIACACHE_MAGIC, .version = MEDIACACHE_VERSION, .num = c->num, .clock = c->clock};
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(c->entries, sizeof(MediaCacheEntry), c->num, f);
+  fclose(f);
+}
+
+static void mediacache_loadindex(MediaCache* c) {
+  FILE* f = fopen(c->idxpath, "rb");
+  if (f == NULL) {
+    return;
+  }
+  MediaCacheHeader h;
+  if (fread(&h, sizeof(h), 1, f) == 1 && h.magic == MEDIACACHE_MAGIC && h.version == MEDIACACHE_VERSION &&
+      h.num > 0) {
+    c->entries = (MediaCacheEntry*)malloc(sizeof(MediaCacheEntry) * h.num);
+    assert(c->entries);
+    c->cap = h.num;
+    c->num = (int)fread(c->entries, sizeof(MediaCacheEntry), h.num, f);
+    c->clock = h.clock;
+  }
+  fclose(f);
+  // drop anything pointing past the end of the pack file, e.g. if we crashed before saving the index
+  for (int i = 0; i < c->num; i++) {
+    if (c->entries[i].offset + c->entries[i].size > c->packsize) {
+      c->entries[i--] = c->entries[--c->num];
+    }
+  }
+  for (int i = 0; i < c->num; i++) {
+    c->stats.bytes += c->entries[i].size;
+  }
+}
+
+static uint64_t mediacache_key(const char* path, double pos_secs, int box_width, int box_height) {
+  int32_t box[2] = {box_width, box_height};
+  uint64_t h = filecache_hash(path, strlen(path), 0);
+  h = filecache_hash(&pos_secs, sizeof(pos_secs), h);
+  return filecache_hash(box, sizeof(box), h);
+}
+
+static MediaCacheEntry* mediacache_find(MediaCache* c, uint64_t key) {
+  for (int i = 0; i < c->num; i++) {
+    if (c->entries[i].key == key) {
+      return &c->entries[i];
+    }
+  }
+  return NULL;
+}
+
+// rewrites the pack file with only the live entries
+static void mediacache_compact(MediaCache* c) {
+  if (c->map.size < c->packsize) {
+    mediacache_map(c);
+  }
+  char tmppath[1040];
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", c->packpath);
+  FILE* f = fopen(tmppath, "wb");
+  if (f == NULL) {
+    return;
+  }
+  uint64_t offset = 0;
+  for (int i = 0; i < c->num; i++) {
+    MediaCacheEntry* e = &c->entries[i];
+    if (c->map.data == NULL || e->offset + e->size > c->map.size) {
+      c->entries[i--] = c->entries[--c->num];
+      continue;
+    }
+    fwrite(c->map.data + e->offset, 1, e->size, f);
+    e->offset = offset;
+    offset += e->size;
+  }
+  fclose(f);
+  filecache_unmap(&c->map);
+  remove(c->packpath);
+  rename(tmppath, c->packpath);
+  c->packsize = offset;
+  c->stats.bytes = (size_t)offset;
+  mediacache_saveindex(c);
+}
+
+static void mediacache_evict(MediaCache* c) {
+  while (c->stats.bytes > c->stats.cap && c->num > 0) {
+    int lru = 0;
+    for (int i = 1; i < c->num; i++) {
+      if (c->entries[i].last_used < c->entries[lru].last_used) {
+        lru = i;
+      }
+    }
+    c->stats.bytes -= c->entries[lru].size;
+    c->entries[lru] = c->entries[--c->num];
+    c->stats.evictions++;
+  }
+  // the pack file only shrinks once most of it is dead
+  if (c->packsize > 1024 * 1024 && c->packsize > 2 * (uint64_t)c->stats.bytes) {
+    mediacache_compact(c);
+  }
+}
+
+void mediacache_init(size_t cap_bytes) {
+  MediaCache* c = &_mediacache;
+  assert(!c->init);
+  *c = (MediaCache){.init = true, .stats.cap = cap_bytes};
+  thread_mutex_init(&c->mtx);
+  snprintf(c->idxpath, sizeof(c->idxpath), "%s/media.idx", filecache_dir());
+  snprintf(c->packpath, sizeof(c->packpath), "%s/media.pack", filecache_dir());
+  FileFingerprint packfp;
+  c->packsize = filecache_fingerprint(c->packpath, &packfp) ? (uint64_t)packfp.size : 0;
+  mediacache_loadindex(c);
+  mediacache_map(c);
+}
+
+void mediacache_shutdown(void) {
+  MediaCache* c = &_mediacache;
+  if (!c->init) {
+    return;
+  }
+  mediacache_saveindex(c);
+  filecache_unmap(&c->map);
+  free(c->entries);
+  thread_mutex_term(&c->mtx);
+  *c = (MediaCache){0};
+}
+
+MediaCacheStats mediacache_stats(void) {
+  MediaCache* c = &_mediacache;
+  thread_mutex_lock(&c->mtx);
+  MediaCacheStats stats = c->stats;
+  stats.num_entries = c->num;
+  thread_mutex_unlock(&c->mtx);
+  return stats;
+}
+
+bool mediacache_get(const char* path, double pos_secs, VideoThumbnail* thumb) {
+  MediaCache* c = &_mediacache;
+  FileFingerprint fp;
+  if (!c->init || !filecache_fingerprint(path, &fp)) {
+    return false;
+  }
+  uint64_t key = mediacache_key(path, pos_secs, thumb->width, thumb->height);
+  thread_mutex_lock(&c->mtx);
+  MediaCacheEntry* e = mediacache_find(c, key);
+  if (e && (e->fp.size != fp.size || e->fp.mtime != fp.mtime)) {
+    // the file has changed since it was cached
+    c->stats.bytes -= e->size;
+    *e = c->entries[--c->num];
+    e = NULL;
+  }
+  if (e && e->offset + e->size > c->map.size) {
+    mediacache_map(c);
+  }
+  uint8_t* pixels = NULL;
+  if (e && e->offset + e->size <= c->map.size) {
+    int w, h, chans;
+    pixels = stbi_load_from_memory(c->map.data + e->offset, (int)e->size, &w, &h, &chans, 4);
+    if (pixels && w == e->width && h == e->height) {
+      e->last_used = ++c->clock;
+      *thumb = (VideoThumbnail){.width = w,
+                                .height = h,
+                                .video_width = e->video_width,
+                                .video_height = e->video_height,
+                                .total_secs = e->total_secs};
+    }
+  }
+  if (pixels) {
+    c->stats.hits++;
+  } else {
+    c->stats.misses++;
+  }
+  thread_mutex_unlock(&c->mtx);
+  if (pixels == NULL) {
+    return false;
+  }
+  // thumbnails are freed with video_free_thumbnail
+  size_t len = (size_t)thumb->width * thumb->height * 4;
+  thumb->pixels = av_malloc(len);
+  memcpy(thumb->pixels, pixels, len);
+  stbi_image_free(pixels);
+  return true;
+}
+
+typedef struct {
+  uint8_t* data;
+  int len, cap;
+} MediaCacheBuf;
+
+static void mediacache_write(void* context, void* data, int size) {
+  MediaCacheBuf* buf = (MediaCacheBuf*)context;
+  if (buf->len + size > buf->cap) {
+    buf->cap = (buf->len + size) * 2;
+    void* newblock = realloc(buf->data, buf->cap);
+    assert(newblock);
+    buf->data = (uint8_t*)newblock;
+  }
+  memcpy(buf->data + buf->len, data, size);
+  buf->len += size;
+}
+
+void mediacache_put(const char* path, double pos_secs, int box_width, int box_height, const VideoThumbnail* thumb) {
+  MediaCache* c = &_mediacache;
+  FileFingerprint fp;
+  if (!c->init || thumb->pixels == NULL || !filecache_fingerprint(path, &fp)) {
+    return;
+  }
+  MediaCacheBuf png = {0};
+  if (!stbi_write_png_to_func(mediacache_write, &png, thumb->width, thumb->height, 4, thumb->pixels,
+                              thumb->width * 4)) {
+    free(png.data);
+    return;
+  }
+  uint64_t key = mediacache_key(path, pos_secs, box_width, box_height);
+  thread_mutex_lock(&c->mtx);
+  FILE* f = fopen(c->packpath, "ab");
+  if (f) {
+    bool ok = fwrite(png.data, 1, png.len, f) == (size_t)png.len;
+    fclose(f);
+    if (ok) {
+      MediaCacheEntry* e = mediacache_find(c, key);
+      if (e) {
+        c->stats.bytes -= e->size;
+      } else {
+        if (c->num + 1 >= c->cap) {
+          c->cap = c->cap ? c->cap * 2 : 256;
+          void* newblock = realloc(c->entries, c->cap * sizeof(MediaCacheEntry));
+          assert(newblock);
+          c->entries = (MediaCacheEntry*)newblock;
+        }
+        e = &c->entries[c->num++];
+      }
+      *e = (MediaCacheEntry){.key = key,
+                             .fp = fp,
+                             .last_used = ++c->clock,
+                             .offset = c->packsize,
+                             .size = (uint32_t)png.len,
+                             .width = thumb->width,
+                             .height = thumb->height,
+                             .video_width = thumb->video_width,
+                             .video_height = thumb->video_height,
+                             .total_secs = thumb->total_secs};
+      c->packsize += png.len;
+      c->stats.bytes += png.len;
+      mediacache_evict(c);
+    }
+  }
+  thread_mutex_unlock(&c->mtx);
+  free(png.data);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// persistent cache of probed media info + thumbnails, keyed by the file's path, size and mtime. thumbnails are stored
+// as PNGs in a single memory-mapped pack file
+
+#define MEDIACACHE_DEFAULT_CAP (256ull * 1024ull * 1024ull)
+
+typedef struct {
+  int64_t hits, misses, evictions;
+  size_t bytes, cap;
+  int num_entries;
+} MediaCacheStats;
+
+void mediacache_init(size_t cap_bytes);
+void mediacache_shutdown(void);
+MediaCacheStats mediacache_stats(void);
+
+typedef struct VideoThumbnail VideoThumbnail;
+// on a hit fills in the thumbnail and its media info, the width + height of 'thumb' must be the requested bounding box
+bool mediacache_get(const char* path, double pos_secs, VideoThumbnail* thumb);
+void mediacache_put(const char* path, double pos_secs, int box_width, int box_height, const VideoThumbnail* thumb);
@@ -0,0 +1,220 @@
+#include "pcm_cache.h"
+#include "file_cache.h"
+#include "audio_convert.h"
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define PCMCACHE_MAGIC (0x43505346) // 'FSPC'
+#define PCMCACHE_VERSION (2)
+// leading silence written for streams that don't start at 0, anything beyond this is treated as a broken pts
+#define PCMCACHE_MAX_LEAD_SECS (10.0)
+
+typedef struct {
+  uint32_t magic, version;
+  int64_t size, mtime;
+  int32_t streamidx, sample_rate, num_channels, pad;
+  int64_t num_frames;
+  char path[1024];
+} PcmCacheHeader;
+
+struct PcmCache {
+  char path[1024], cachepath[1024];
+  int streamidx, sample_rate, num_channels;
+  FileFingerprint fp;
+
+  thread_ptr_t thread;
+  thread_atomic_int_t ready, cancel;
+
+  // set before ready
+  FileMap map;
+  const float* frames;
+  int64_t num_frames;
+};
+
+static bool pcmcache_load(PcmCache* pc) {
+  if (!filecache_map(pc->cachepath, 0, &pc->map)) {
+    return false;
+  }
+  const PcmCacheHeader* h = (const PcmCacheHeader*)pc->map.data;
+  size_t framebytes = sizeof(float) * pc->num_channels;
+  bool ok = pc->map.size >= sizeof(PcmCacheHeader) && h->magic == PCMCACHE_MAGIC &&
+            h->version == PCMCACHE_VERSION && h->size == pc->fp.size && h->mtime == pc->fp.mtime &&
+            h->streamidx == pc->streamidx && h->sample_rate == pc->sample_rate &&
+            h->num_channels == pc->num_channels && strncmp(h->path, pc->path, sizeof(h->path)) == 0 &&
+            h->num_frames >= 0 && (uint64_t)h->num_frames <= (pc->map.size - sizeof(PcmCacheHeader)) / framebytes;
+  if (!ok) {
+    filecache_unmap(&pc->map);
+    return false;
+  }
+  pc->frames = (const float*)(pc->map.data + sizeof(PcmCacheHeader));
+  pc->num_frames = h->num_frames;
+  return true;
+}
+
+static void pcmcache_writesilence(FILE* f, int64_t num_frames, int num_channels) {
+  float zeros[1024] = {0};
+  int64_t n = num_frames * num_channels;
+  while (n > 0) {
+    int num = n < 1024 ? (int)n : 1024;
+    fwrite(zeros, sizeof(float), num, f);
+    n -= num;
+  }
+}
+
+// decodes the audio stream straight into the cache file. the header is only filled in once everything has been
+// written, so a file that was cut short never loads
+static bool pcmcache_build(PcmCache* pc) {
+  AVFormatContext* fmt_ctx = NULL;
+  AVCodecContext* codec_ctx = NULL;
+  AudioConvert* convert = NULL;
+  AVPacket* packet = av_packet_alloc();
+  AVFrame* frame = av_frame_alloc();
+  FILE* f = NULL;
+  bool ok = false;
+  if (avformat_open_input(&fmt_ctx, pc->path, NULL, NULL) != 0) {
+    goto cleanup;
+  }
+  if ((int)fmt_ctx->nb_streams <= pc->streamidx && avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+    goto cleanup;
+  }
+  if ((int)fmt_ctx->nb_streams <= pc->streamidx) {
+    goto cleanup;
+  }
+  AVStream* stream = fmt_ctx->streams[pc->streamidx];
+  const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+  codec_ctx = codec ? avcodec_alloc_context3(codec) : NULL;
+  if (codec_ctx == NULL || avcodec_parameters_to_context(codec_ctx, stream->codecpar) != 0) {
+    goto cleanup;
+  }
+  codec_ctx->thread_count = 1;
+  if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+    goto cleanup;
+  }
+  for (int i = 0; i < (int)fmt_ctx->nb_streams; i++) {
+    fmt_ctx->streams[i]->discard = i == pc->streamidx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+  f = fopen(pc->cachepath, "wb");
+  if (f == NULL) {
+    goto cleanup;
+  }
+  PcmCacheHeader header = {0};
+  fwrite(&header, sizeof(header), 1, f);
+  convert = audioconvert_create();
+  int64_t num_frames = 0;
+  bool started = false, cancelled = false;
+  while (!cancelled && av_read_frame(fmt_ctx, packet) >= 0) {
+    if (packet->stream_index == pc->streamidx && avcodec_send_packet(codec_ctx, packet) >= 0) {
+      while (avcodec_receive_frame(codec_ctx, frame) >= 0) {
+        // place the first frame at its pts, everything after it follows on without gaps
+        if (!started && frame->pts != AV_NOPTS_VALUE) {
+          double secs = frame->pts * av_q2d(stream->time_base);
+          if (secs > 0.0 && secs < PCMCACHE_MAX_LEAD_SECS) {
+            num_frames = (int64_t)(secs * pc->sample_rate);
+            pcmcache_writesilence(f, num_frames, pc->num_channels);
+          }
+        }
+        started = true;
+        const float* pcm;
+        int num = audioconvert_frame(convert, frame, pc->sample_rate, pc->num_channels, &pcm);
+        fwrite(pcm, sizeof(float) * pc->num_channels, num, f);
+        num_frames += num;
+        av_frame_unref(frame);
+      }
+    }
+    av_packet_unref(packet);
+    cancelled = thread_atomic_int_load(&pc->cancel) != 0;
+  }
+  if (!cancelled && !ferror(f)) {
+    header = (PcmCacheHeader){.magic = PCMCACHE_MAGIC,
+                              .version = PCMCACHE_VERSION,
+                              .size = pc->fp.size,
+                              .mtime = pc->fp.mtime,
+                              .streamidx = pc->streamidx,
+                              .sample_rate = pc->sample_rate,
+                              .num_channels = pc->num_channels,
+                              .num_frames = num_frames};
+    snprintf(header.path, sizeof(header.path), "%s", pc->path);
+    fseek(f, 0, SEEK_SET);
+    ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  }
+cleanup:
+  if (f) {
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+      remove(pc->cachepath);
+    }
+  }
+  audioconvert_free(convert);
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+  if (codec_ctx) {
+    avcodec_free_context(&codec_ctx);
+  }
+  if (fmt_ctx) {
+    avformat_close_input(&fmt_ctx);
+  }
+  return ok;
+}
+
+static int pcmcache_thread(void* user_data) {
+  PcmCache* pc = (PcmCache*)user_data;
+  if (pcmcache_load(pc) || (pcmcache_build(pc) && pcmcache_load(pc))) {
+    thread_atomic_int_store(&pc->ready, 1);
+  }
+  return 0;
+}
+
+PcmCache* pcmcache_open(const char* path, int streamidx, int sample_rate, int num_channels) {
+  PcmCache* pc = (PcmCache*)calloc(1, sizeof(PcmCache));
+  assert(pc);
+  snprintf(pc->path, sizeof(pc->path), "%s", path);
+  pc->streamidx = streamidx;
+  pc->sample_rate = sample_rate;
+  pc->num_channels = num_channels;
+  char ext[32];
+  snprintf(ext, sizeof(ext), "fspcm%d_%d", sample_rate, num_channels); // one file per output format
+  if (!filecache_fingerprint(path, &pc->fp) || !filecache_path(path, ext, pc->cachepath, sizeof(pc->cachepath))) {
+    return pc; // never becomes ready, the audio is decoded as it plays
+  }
+  thread_atomic_int_store(&pc->ready, 0);
+  thread_atomic_int_store(&pc->cancel, 0);
+  pc->thread = thread_create(pcmcache_thread, pc, "pcm cache", THREAD_STACK_SIZE_DEFAULT);
+  return pc;
+}
+
+void pcmcache_free(PcmCache* pc) {
+  if (pc == NULL) {
+    return;
+  }
+  if (pc->thread) {
+    thread_atomic_int_store(&pc->cancel, 1);
+    thread_join(pc->thread);
+    thread_destroy(pc->thread);
+  }
+  filecache_unmap(&pc->map);
+  free(pc);
+}
+
+bool pcmcache_ready(PcmCache* pc) {
+  return pc && thread_atomic_int_load(&pc->ready);
+}
+
+bool pcmcache_matches(PcmCache* pc, int sample_rate, int num_channels) {
+  return pc->sample_rate == sample_rate && pc->num_channels == num_channels;
+}
+
+void pcmcache_read(PcmCache* pc, int64_t frame, float* out, int num_frames) {
+  int ch = pc->num_channels;
+  int64_t start = frame > 0 ? frame : 0, end = frame + num_frames < pc->num_frames ? frame + num_frames : pc->num_frames;
+  if (start >= end) {
+    memset(out, 0, sizeof(float) * num_frames * ch);
+    return;
+  }
+  int lead = (int)(start - frame), num = (int)(end - start);
+  memset(out, 0, sizeof(float) * lead * ch);
+  memcpy(out + lead * ch, pc->frames + start * ch, sizeof(float) * num * ch);
+  memset(out + (lead + num) * ch, 0, sizeof(float) * (num_frames - lead - num) * ch);
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// a file's audio decoded once on a background thread into a cache file of interleaved floats at the output rate +
+// channel count. once it's ready the file is mapped, and any position can be read without touching a decoder.
+// frame 0 is at pts 0 of the audio stream
+
+typedef struct PcmCache PcmCache;
+
+PcmCache* pcmcache_open(const char* path, int streamidx, int sample_rate, int num_channels);
+void pcmcache_free(PcmCache* pc);
+bool pcmcache_ready(PcmCache* pc);
+bool pcmcache_matches(PcmCache* pc, int sample_rate, int num_channels);
+
+// copies num_frames from 'frame' on into out, anything outside the decoded audio is silence. only once ready
+void pcmcache_read(PcmCache* pc, int64_t frame, float* out, int num_frames);
@@ -0,0 +1,224 @@
+#include "thumbnails.h"
+#include "media_cache.h"
+#include "video.h"
+#include "debuglog.h"
+#include <sokol/sokol_gfx.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define THUMBNAILS_MAX_THREADS (16)
+#define _THUMBNAILS_SLOT_SHIFT (16)
+#define _THUMBNAILS_SLOT_MASK ((1 << _THUMBNAILS_SLOT_SHIFT) - 1)
+
+typedef enum {
+  ThumbnailState_Free = 0,
+  ThumbnailState_Pending,
+  ThumbnailState_Running,
+  ThumbnailState_Done,
+} ThumbnailState;
+
+typedef struct {
+  uint32_t id;
+  ThumbnailState state;
+  bool cancelled;
+  int priority;
+  uint32_t seq;
+  char path[1024];
+  double pos_secs;
+  VideoThumbnail thumb;
+  const char* err;
+} ThumbnailRequest;
+
+typedef struct {
+  thread_mutex_t mtx;
+  thread_signal_t signal;
+  thread_atomic_int_t exit;
+  thread_ptr_t threads[THUMBNAILS_MAX_THREADS];
+  int num_threads;
+  uint32_t seq;
+  uint32_t gen_ctrs[THUMBNAILS_MAX_REQUESTS];
+  ThumbnailRequest requests[THUMBNAILS_MAX_REQUESTS];
+} Thumbnails;
+static Thumbnails _thumbnails;
+
+static ThumbnailRequest* thumbnails_lookup(ThumbnailId id) {
+  int slot_index = (int)(id.id & _THUMBNAILS_SLOT_MASK);
+  if (id.id == 0 || slot_index >= THUMBNAILS_MAX_REQUESTS) {
+    return NULL;
+  }
+  ThumbnailRequest* r = &_thumbnails.requests[slot_index];
+  return r->id == id.id ? r : NULL;
+}
+
+// highest priority, then oldest pending request
+static ThumbnailRequest* thumbnails_next(Thumbnails* t) {
+  ThumbnailRequest* best = NULL;
+  for (int i = 0; i < THUMBNAILS_MAX_REQUESTS; i++) {
+    ThumbnailRequest* r = &t->requests[i];
+    if (r->state != ThumbnailState_Pending) {
+      continue;
+    }
+    if (best == NULL || r->priority > best->priority || (r->priority == best->priority && r->seq < best->seq)) {
+      best = r;
+    }
+  }
+  return best;
+}
+
+static int thumbnails_thread(void* user_data) {
+  Thumbnails* t = (Thumbnails*)user_data;
+  while (thread_atomic_int_load(&t->exit) == 0) {
+    thread_mutex_lock(&t->mtx);
+    ThumbnailRequest* r = thumbnails_next(t);
+    if (r == NULL) {
+      thread_mutex_unlock(&t->mtx);
+      thread_signal_wait(&t->signal, 100);
+      continue;
+    }
+    r->state = ThumbnailState_Running;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s", r->path);
+    double pos_secs = r->pos_secs;
+    VideoThumbnail thumb = r->thumb;
+    thread_mutex_unlock(&t->mtx);
+
+    const char* err = NULL;
+    int box_width = thumb.width, box_height = thumb.height;
+    if (!mediacache_get(path, pos_secs, &thumb)) {
+      err = video_decode_thumbnail(path, pos_secs, &thumb);
+      if (err) {
+        DebugLog("failed to make thumbnail for %s: %s\n", path, err);
+      } else {
+        mediacache_put(path, pos_secs, box_width, box_height, &thumb);
+      }
+    }
+
+    thread_mutex_lock(&t->mtx);
+    if (r->cancelled) {
+      video_free_thumbnail(&thumb);
+      *r = (ThumbnailRequest){0};
+    } else {
+      r->thumb = thumb;
+      r->err = err;
+      r->state = ThumbnailState_Done;
+    }
+    thread_mutex_unlock(&t->mtx);
+  }
+  return 0;
+}
+
+void thumbnails_init(int num_threads) {
+  Thumbnails* t = &_thumbnails;
+  thread_mutex_init(&t->mtx);
+  thread_signal_init(&t->signal);
+  thread_atomic_int_store(&t->exit, 0);
+  t->num_threads = num_threads < THUMBNAILS_MAX_THREADS ? num_threads : THUMBNAILS_MAX_THREADS;
+  for (int i = 0; i < t->num_threads; i++) {
+    t->threads[i] = thread_create(thumbnails_thread, t, "thumbnails", THREAD_STACK_SIZE_DEFAULT);
+  }
+}
+
+void thumbnails_shutdown(void) {
+  Thumbnails* t = &_thumbnails;
+  thread_atomic_int_store(&t->exit, 1);
+  for (int i = 0; i < t->num_threads; i++) {
+    thread_signal_raise(&t->signal);
+  }
+  for (int i = 0; i < t->num_threads; i++) {
+    thread_join(t->threads[i]);
+    thread_destroy(t->threads[i]);
+  }
+  for (int i = 0; i < THUMBNAILS_MAX_REQUESTS; i++) {
+    video_free_thumbnail(&t->requests[i].thumb);
+  }
+  thread_signal_term(&t->signal);
+  thread_mutex_term(&t->mtx);
+}
+
+ThumbnailId thumbnails_request(const char* path, double pos_secs, int width, int height, int priority) {
+  Thumbnails* t = &_thumbnails;
+  thread_mutex_lock(&t->mtx);
+  ThumbnailId id = {0};
+  // never use the zero-th slot since the invalid id is 0
+  for (int i = 1; i < THUMBNAILS_MAX_REQUESTS; i++) {
+    ThumbnailRequest* r = &t->requests[i];
+    if (r->state != ThumbnailState_Free) {
+      continue;
+    }
+    uint32_t ctr = ++t->gen_ctrs[i];
+    *r = (ThumbnailRequest){.id = (ctr << _THUMBNAILS_SLOT_SHIFT) | (uint32_t)i,
+                            .state = ThumbnailState_Pending,
+                            .priority = priority,
+                            .seq = t->seq++,
+                            .pos_secs = pos_secs,
+                            .thumb = {.width = width, .height = height}};
+    snprintf(r->path, sizeof(r->path), "%s", path);
+    id.id = r->id;
+    break;
+  }
+  thread_mutex_unlock(&t->mtx);
+  thread_signal_raise(&t->signal);
+  return id;
+}
+
+void thumbnails_prioritize(ThumbnailId id, int priority) {
+  Thumbnails* t = &_thumbnails;
+  thread_mutex_lock(&t->mtx);
+  ThumbnailRequest* r = thumbnails_lookup(id);
+  if (r) {
+    r->priority = priority;
+  }
+  thread_mutex_unlock(&t->mtx);
+}
+
+void thumbnails_cancel(ThumbnailId id) {
+  Thumbnails* t = &_thumbnails;
+  thread_mutex_lock(&t->mtx);
+  ThumbnailRequest* r = thumbnails_lookup(id);
+  if (r) {
+    if (r->state == ThumbnailState_Running) {
+      r->cancelled = true; // the worker frees it once it's done
+    } else {
+      video_free_thumbnail(&r->thumb);
+      *r = (ThumbnailRequest){0};
+    }
+  }
+  thread_mutex_unlock(&t->mtx);
+}
+
+bool thumbnails_take(ThumbnailId id, sg_image* img, int* width, int* height, double* total_secs) {
+  Thumbnails* t = &_thumbnails;
+  thread_mutex_lock(&t->mtx);
+  ThumbnailRequest* r = thumbnails_lookup(id);
+  if (r == NULL || r->state != ThumbnailState_Done) {
+    thread_mutex_unlock(&t->mtx);
+    return false;
+  }
+  VideoThumbnail thumb = r->thumb;
+  bool ok = r->err == NULL && thumb.pixels;
+  *r = (ThumbnailRequest){0};
+  thread_mutex_unlock(&t->mtx);
+
+  // the duration is probed before the frame is decoded, a file whose frame fails can still be placed
+  if (total_secs) {
+    *total_secs = thumb.total_secs;
+  }
+  *img = (sg_image){0};
+  if (ok) {
+    *img = sg_make_image(&(sg_image_desc){
+        .width = thumb.width,
+        .height = thumb.height,
+        .pixel_format = SG_PIXELFORMAT_RGBA8,
+        .min_filter = SG_FILTER_LINEAR,
+        .mag_filter = SG_FILTER_LINEAR,
+        .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+        .data.subimage[0][0] = {.ptr = thumb.pixels, .size = (size_t)thumb.width * thumb.height * 4},
+    });
+    *width = thumb.width;
+    *height = thumb.height;
+  }
+  video_free_thumbnail(&thumb);
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// generates thumbnails on a pool of worker threads, the main thread polls for results and turns them into images
+
+typedef struct {
+  uint32_t id;
+} ThumbnailId;
+
+#define THUMBNAILS_MAX_REQUESTS (4096)
+
+void thumbnails_init(int num_threads);
+void thumbnails_shutdown(void);
+
+// higher priority requests are decoded first
+ThumbnailId thumbnails_request(const char* path, double pos_secs, int width, int height, int priority);
+void thumbnails_prioritize(ThumbnailId id, int priority);
+void thumbnails_cancel(ThumbnailId id);
+
+struct sg_image;
+// once the request has finished this makes the image and frees the request, the caller takes ownership of the image.
+// img is left invalid if the thumbnail couldn't be decoded, *total_secs is still set if the file could be probed
+bool thumbnails_take(ThumbnailId id, struct sg_image* img, int* width, int* height, double* total_secs);
@@ -439,6 +439,20 @@ static Vec2 vec2_add(Vec2 a, Vec2 b) {
   return (Vec2){.x = a.x + b.y, .y = a.y + b.y};
 }
 
+void ui_draw_rects(UI* u, Color col, const Rect* rects, int num_rects) {
+  sgl_disable_texture();
+  sgl_begin_quads();
+  sgl_load_pipeline(u->box_flat_pip);
+  for (int i = 0; i < num_rects; i++) {
+    Rect r = rects[i];
+    sgl_v2f_c4b(r.minx, r.miny, col.r, col.g, col.b, col.a);
+    sgl_v2f_c4b(r.maxx, r.miny, col.r, col.g, col.b, col.a);
+    sgl_v2f_c4b(r.maxx, r.maxy, col.r, col.g, col.b, col.a);
+    sgl_v2f_c4b(r.minx, r.maxy, col.r, col.g, col.b, col.a);
+  }
+  sgl_end();
+}
+
 void ui_draw_lines(UI* u, Color col, float width, Vec2* points, int num_points) {
   sgl_disable_texture();
   sgl_begin_quads();
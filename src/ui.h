@@ -101,6 +101,8 @@ typedef struct {
   double x, y;
 } Vec2;
 void ui_draw_lines(UI* u, Color col, float width, Vec2* points, int num_points);
+// flat unrounded rectangles in a single batch
+void ui_draw_rects(UI* u, Color col, const Rect* rects, int num_rects);
 
 typedef enum {
   TextAlign_None = 0,
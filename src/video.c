@@ -1,4 +1,11 @@
 #include "video.h"
+#include "video_index.h"
+#include "waveform.h"
+#include "pcm_cache.h"
+#include "frame_cache.h"
+#include "file_cache.h"
+#include "yuv_convert.h"
+#include "audio_convert.h"
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
@@ -9,78 +16,276 @@
 #include <libavutil/opt.h>
 #include <libswresample/swresample.h>
 #include <sokol/sokol_audio.h>
+#include <sokol/sokol_time.h>
+#include "../data/yuv.h"
 
-#define MAX_QUEUE_LEN (256)
-
+// packets are moved into the queue and popped packets are handed back with packet_queue_release, the AVPacket
+// shells are recycled through a freelist so playback doesn't allocate any once the queue has filled up once. the
+// queue grows as needed, how much gets buffered is decided by the byte + duration watermarks in limits
 typedef struct {
-  AVPacket* queue[MAX_QUEUE_LEN];
-  int head, tail, num_packets;
+  AVPacket** queue;
+  int cap, head, num_packets;
+  AVPacket** free; // same capacity as queue
+  int num_free;
+  int64_t bytes, duration;
+  AVRational time_base;
+  VideoQueueLimits limits;
+  thread_atomic_int_t allocs;
 } PacketQueue;
 
+#define PACKET_QUEUE_INITIAL_CAP (64)
+
+// video buffers enough to ride out a slow disk even for intra-only sources with frames of several MB, audio packets
+// are tiny so they're bounded by duration
+static const VideoQueueLimits video_queue_defaults = {
+    .low_bytes = 8 << 20, .high_bytes = 128 << 20, .low_secs = 0.5, .high_secs = 2.0};
+static const VideoQueueLimits audio_queue_defaults = {
+    .low_bytes = 16 << 10, .high_bytes = 4 << 20, .low_secs = 0.5, .high_secs = 4.0};
+
+static void packet_queue_init(PacketQueue* q, AVRational time_base, const VideoQueueLimits* limits,
+                              const VideoQueueLimits* defaults) {
+  q->time_base = time_base;
+  q->limits = *defaults;
+  if (limits->high_bytes > 0) {
+    q->limits = *limits;
+  }
+}
+static double packet_queue_secs(PacketQueue* q) {
+  return (double)q->duration * av_q2d(q->time_base);
+}
+// at the high watermark, stop reading ahead for this queue
 static bool packet_queue_full(PacketQueue* q) {
-  return q->num_packets >= MAX_QUEUE_LEN;
+  return q->bytes >= q->limits.high_bytes || packet_queue_secs(q) >= q->limits.high_secs;
+}
+// below the low watermark, start reading ahead again
+static bool packet_queue_low(PacketQueue* q) {
+  return !packet_queue_full(q) && (q->bytes < q->limits.low_bytes || packet_queue_secs(q) < q->limits.low_secs);
+}
+static void packet_queue_grow(PacketQueue* q) {
+  int cap = q->cap ? q->cap * 2 : PACKET_QUEUE_INITIAL_CAP;
+  AVPacket** queue = (AVPacket**)calloc(cap, sizeof(AVPacket*));
+  for (int i = 0; i < q->num_packets; i++) {
+    queue[i] = q->queue[(q->head + i) % q->cap];
+  }
+  free(q->queue);
+  q->queue = queue;
+  q->head = 0;
+  q->free = (AVPacket**)realloc(q->free, cap * sizeof(AVPacket*));
+  q->cap = cap;
 }
+// takes over the data of p, leaving it blank
 static void packet_queue_put(PacketQueue* q, AVPacket* p) {
-  assert(!packet_queue_full(q));
-  int tailidx = q->tail % MAX_QUEUE_LEN;
-  assert(tailidx < MAX_QUEUE_LEN && q->queue[tailidx] == NULL);
-  q->queue[tailidx] = av_packet_alloc();
-  av_packet_ref(q->queue[tailidx], p);
-  q->tail++;
+  if (q->num_packets == q->cap) {
+    packet_queue_grow(q);
+  }
+  AVPacket* shell;
+  if (q->num_free > 0) {
+    shell = q->free[--q->num_free];
+  } else {
+    shell = av_packet_alloc();
+    thread_atomic_int_inc(&q->allocs);
+  }
+  av_packet_move_ref(shell, p);
+  q->queue[(q->head + q->num_packets) % q->cap] = shell;
   q->num_packets++;
+  q->bytes += shell->size;
+  q->duration += FFMAX(shell->duration, 0);
+}
+// unrefs a popped packet and returns its shell to the freelist
+static void packet_queue_release(PacketQueue* q, AVPacket* p) {
+  av_packet_unref(p);
+  if (q->num_free < q->cap) {
+    q->free[q->num_free++] = p;
+  } else {
+    av_packet_free(&p); // a popped packet was still out when the queue last filled up
+  }
 }
 static AVPacket* packet_queue_pop(PacketQueue* q) {
   if (q->num_packets <= 0) {
     return NULL;
   }
-  int headidx = q->head % MAX_QUEUE_LEN;
-  assert(headidx < MAX_QUEUE_LEN && q->queue[headidx]);
-  AVPacket* p = q->queue[headidx];
-  q->queue[headidx] = NULL;
-  q->head++;
+  AVPacket* p = q->queue[q->head];
+  q->queue[q->head] = NULL;
+  q->head = (q->head + 1) % q->cap;
   q->num_packets--;
+  q->bytes -= p->size;
+  q->duration -= FFMAX(p->duration, 0);
   return p;
 }
 static void packet_queue_clear(PacketQueue* q) {
-  for (int i = 0; i < MAX_QUEUE_LEN; i++) {
-    if (q->queue[i]) {
-      av_packet_unref(q->queue[i]);
-    }
-    q->queue[i] = NULL;
+  AVPacket* p;
+  while ((p = packet_queue_pop(q)) != NULL) {
+    packet_queue_release(q, p);
   }
-  *q = (PacketQueue){0};
+  q->head = 0;
+  q->bytes = q->duration = 0;
 }
+// clears the queue and frees the recycled shells
+static void packet_queue_free(PacketQueue* q) {
+  packet_queue_clear(q);
+  for (int i = 0; i < q->num_free; i++) {
+    av_packet_free(&q->free[i]);
+  }
+  free(q->queue);
+  free(q->free);
+  q->queue = q->free = NULL;
+  q->cap = q->num_free = 0;
+}
+
+#define VIDEO_RING_SIZE (4)
+// displayed frames rotate through this many textures, so an upload never overwrites one the GPU may still be drawing
+#define VIDEO_TEXTURE_RING (3)
+// audio read from the pcm cache is moved back to the playhead once it's this far off
+#define VIDEO_PCM_RESYNC_SECS (0.25)
+// a scrub grain plays this long after each jump of the playhead, fading in + out over VIDEO_PCM_GRAIN_FADE_FRAMES
+#define VIDEO_PCM_GRAIN_SECS (0.06)
+#define VIDEO_PCM_GRAIN_FADE_FRAMES (128)
+// when decoding falls this far behind the playhead the decoder discards non-reference frames, and then everything but
+// keyframes, until it's caught up
+#define VIDEO_SKIP_NONREF_FRAMES (2)
+#define VIDEO_SKIP_NONKEY_SECS (0.5)
+// reverse playback decodes a GOP forward in segments of up to this many frames, and hands each one out newest first
+#define VIDEO_REVERSE_STACK (16)
+// until the index is ready, reverse playback seeks this far back to find the keyframe it needs
+#define VIDEO_REVERSE_FALLBACK_SECS (1.0)
+// backward jumps further than this restart reverse playback at the new position instead of decoding through
+#define VIDEO_REVERSE_JUMP_SECS (2.0)
+
+// how a converted frame is laid out in a staging buffer: RGBA, or the 8-bit YUV planes packed back to back for the
+// yuv shader
+typedef enum {
+  VideoLayout_Rgba = 0,
+  VideoLayout_Yuv420p,
+  VideoLayout_Yuv422p,
+  VideoLayout_Nv12,
+} VideoLayout;
+
+typedef struct {
+  VideoLayout layout;
+  bool bt709, full_range;
+} VideoPlanes;
+
+// a decoded frame already converted for display, waiting to be uploaded
+typedef struct {
+  uint8_t* buf;
+  uint8_t* data[4];
+  int linesize[4];
+  VideoPlanes planes;
+  double pts_secs;
+  int gen;
+  bool preview; // an earlier frame shown while the one at the requested position is still being decoded
+} VideoFrame;
+
+// the part of a video that only depends on the file, shared by every Video opened on it. each Video is a decode cursor
+// with its own demuxer, decoders, queues and textures, so clips using the same source at different positions don't
+// seek one decoder back and forth. the keyframe index, waveform, pcm cache and cached frames are built once per file
+typedef struct {
+  char path[_MAX_PATH + 1];
+  uint64_t key;
+  int refs;
+  VideoIndex* index;
+  Waveform* waveform;
+  PcmCache* pcm;
+} VideoFile;
 
 typedef struct {
   uint32_t id;
+  VideoFile* file;
+  VideoOpenParams params; // what it was opened with, for opening more cursors on the same file
 
   AVFormatContext* fmt_ctx;
   AVCodecParameters* codec_params;
   AVCodecContext* codec_ctx;
   AVFrame *frame_raw, *frame_rgb;
   struct SwsContext* sws_ctx;
-  sg_image img;
+  sg_image img[VIDEO_TEXTURE_RING];
+  int img_shown;     // the texture ring slot holding the newest complete frame
+  bool img_handedout; // video_image returned the shown slot since it was uploaded, so it may be in flight
   uint8_t* imgbuf;
   int imgbuflen;
   int vidstreamidx;
 
-  AVFormatContext* aud_fmt_ctx;
   AVCodecParameters* aud_codec_params;
   AVCodecContext* aud_codec_ctx;
   int audiostreamidx;
 
   PacketQueue vid_queue;
+  AVPacket* read_pkt; // av_read_frame demuxes into this before it's moved into one of the queues
 
   // protected by aud_thread_mtx
   PacketQueue aud_queue;
   AVFrame* aud_frame_raw;
-  int aud_frame_pos;
+  AudioConvert* aud_convert;
+  const float* aud_pcm; // the last decoded frame, converted to the output rate + channels
+  int aud_pcm_frames, aud_frame_pos;
   bool aud_got_frame, aud_playing;
+  bool aud_muted; // shuttling at any speed but 1x, nothing is read from the queue or the cache
+  int aud_gen; // bumped whenever the queued audio is thrown away
+  // once the pcm cache is ready the audio is read from it instead of being demuxed + decoded. while scrubbing each jump
+  // of the playhead plays a short grain from the new position
+  thread_atomic_int_t aud_cached;
+  int64_t aud_pcm_pos;
+  int aud_pcm_rate;
+  int aud_grain_pos, aud_grain_frames; // aud_grain_frames is 0 when playing continuously
+
+  VideoOpenProfile profile;
+  int out_width, out_height, out_div; // size of the staging buffers + texture, out_div is the preview divisor
+
+  // frames at the output size can skip the CPU conversion: their planes are uploaded as is and the yuv shader draws
+  // them into the rgb_img slot that's next in the texture ring
+  bool gpu_yuv;
+  VideoLayout plane_layout;
+  VideoPlanes shown_planes;
+  sg_image plane_img[3];
+  sg_image rgb_img[VIDEO_TEXTURE_RING];
+  sg_pass rgb_pass[VIDEO_TEXTURE_RING];
 
-  char filepath[_MAX_PATH + 1];
+  uint64_t framekey;
 
-  double pos_secs, next_swap_secs, total_secs;
+  double pos_secs, next_swap_secs, total_secs, shown_secs;
+  double seek_window_secs, frame_secs;
+  bool needs_seek;
+  // owned by whoever decodes: the decode thread when async. frame skipping only kicks in once a frame has been shown
+  // since the last seek, decoding up to the seek target is never skipped
+  bool decode_settled;
+  double last_decoded_secs;
+  enum AVDiscard skip_floor; // keyframes only while shuttling fast
+  double decode_speed;       // the shuttle speed being decoded for, at 1x the audio read along the way is kept
+  int64_t run_key_pts;       // the keyframe decoding last started from, AV_NOPTS_VALUE if it isn't known
+  double shuttle;            // the playback speed set by video_setshuttle, negative plays in reverse
+  VideoStats stats;
   bool gc_marked;
+
+  // async decode: the worker thread owns fmt_ctx, the decoders and vid_queue
+  bool async;
+  thread_ptr_t decode_thread;
+  thread_signal_t decode_signal;
+  thread_atomic_int_t decode_exit;
+  thread_mutex_t codec_mtx; // held by the worker while demuxing + decoding
+
+  // reverse playback, owned by the worker + protected by codec_mtx. a segment of the frames before rev_end_secs is
+  // decoded forward into the back stack while the front stack is handed to the ring newest first, then they swap
+  VideoFrame rev_stack[2][VIDEO_REVERSE_STACK];
+  int rev_front, rev_num[2];
+  double rev_end_secs, rev_seek_secs; // rev_seek_secs is < 0 until the segment's keyframe has been looked up
+  bool rev_seeked, rev_filled, rev_atstart;
+
+  // protected by decode_mtx
+  thread_mutex_t decode_mtx;
+  VideoFrame ring[VIDEO_RING_SIZE];
+  int ring_head, ring_num;
+  double req_pos_secs, req_speed, decoded_secs;
+  int req_gen;
+  bool req_reverse, req_keyonly;
+  thread_mutex_t* aud_thread_mtx;
+  // main thread only: set while the latest request came from video_prefetch and nothing has been played from it yet.
+  // the request is then carried on from its own position instead of wherever the video was last played
+  bool prefetch_pending;
+  // scrub latency, main thread only: from the request for a new position to the first image of it and to the exact
+  // frame being uploaded
+  uint64_t scrub_start;
+  int scrub_gen;
+  bool scrub_pending, scrub_previewed;
 } Video;
 
 typedef struct {
@@ -89,9 +294,12 @@ typedef struct {
   uint32_t* gen_ctrs;
   int* free_queue;
   Video* videos;
+  VideoFile* files; // a slot is free while its refs is 0
 } VideoPool;
 static VideoPool _videos;
 
+static void videopool_initscalers(void);
+
 void videopool_init() {
   VideoPool* pool = &_videos;
   pool->queue_top = 0;
@@ -111,6 +319,10 @@ void videopool_init() {
   pool->videos = (Video*)malloc(pool_byte_size);
   assert(pool->videos);
   memset(pool->videos, 0, pool_byte_size);
+  pool->files = (VideoFile*)calloc((size_t)VIDEO_POOL_SIZE, sizeof(VideoFile));
+  assert(pool->files);
+  framecache_init(FRAMECACHE_DEFAULT_BUDGET);
+  videopool_initscalers();
 }
 
 #define _VIDEO_INVALIDID (0)
@@ -171,20 +383,281 @@ static void _video_free(VideoId id) {
   *v = (Video){0};
 }
 
-VideoOpenRes video_open(const char* path, const VideoOpenParams* p) {
-  VideoId vid = _video_alloc();
-  Video* v = _video_at(vid);
-  snprintf(v->filepath, sizeof(v->filepath), "%.*s", (int)strlen(path), path);
+// videos are only opened + closed on the main thread, so the file table needs no lock
+static VideoFile* videofile_acquire(const char* path) {
+  VideoPool* pool = &_videos;
+  VideoFile* file = NULL;
+  for (int i = 0; i < VIDEO_POOL_SIZE; i++) {
+    VideoFile* f = &pool->files[i];
+    if (f->refs > 0 && strcmp(f->path, path) == 0) {
+      f->refs++;
+      return f;
+    }
+    if (f->refs == 0 && file == NULL) {
+      file = f;
+    }
+  }
+  assert(file); // every Video holds one reference, so there's always a free slot
+  *file = (VideoFile){.refs = 1, .key = filecache_hash(path, strlen(path), 0)};
+  snprintf(file->path, sizeof(file->path), "%.*s", (int)strlen(path), path);
+  return file;
+}
+
+static void videofile_release(VideoFile* file) {
+  if (file == NULL || --file->refs > 0) {
+    return;
+  }
+  videoindex_free(file->index);
+  waveform_free(file->waveform);
+  pcmcache_free(file->pcm);
+  *file = (VideoFile){0};
+}
+
+typedef struct {
+  const char* probesize;       // bytes read when detecting the streams, NULL keeps the ffmpeg default
+  const char* analyzeduration; // microseconds of packets read when filling in the stream info
+  int thread_count;            // decoder threads, 0 is one per core
+  int thread_type;
+  bool staging, texture, audio;
+} VideoProfile;
+
+static const VideoProfile video_profiles[] = {
+    [VideoOpenProfile_Preview] = {.thread_type = FF_THREAD_SLICE, // frame threads would add a frame of latency each
+                                  .staging = true,
+                                  .texture = true,
+                                  .audio = true},
+    [VideoOpenProfile_Export] = {.probesize = "52428800",
+                                 .analyzeduration = "10000000",
+                                 .thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE,
+                                 .staging = true,
+                                 .audio = true},
+};
+
+// video_decode_thumbnail doesn't open a Video, its demuxer + single-threaded decoder only need the probe sizes
+static const VideoProfile video_thumbnail_profile = {.probesize = "1048576",
+                                                     .analyzeduration = "1000000",
+                                                     .thread_count = 1}; // there's a whole pool of these at once
 
-  const char* err = NULL;
-  int res = avformat_open_input(&v->fmt_ctx, path, NULL, NULL);
+// opens the demuxer and reads the stream info, probing as much of the file as the profile asks for. 'interrupt' can
+// cut a slow probe short, it's NULL when nothing will
+static const char* video_openformat(const char* path, const VideoProfile* desc, const AVIOInterruptCB* interrupt,
+                                    AVFormatContext** fmt_ctx) {
+  if (interrupt) {
+    *fmt_ctx = avformat_alloc_context();
+    if (*fmt_ctx == NULL) {
+      return "Failed to open video";
+    }
+    (*fmt_ctx)->interrupt_callback = *interrupt;
+  }
+  AVDictionary* opts = NULL;
+  if (desc->probesize) {
+    av_dict_set(&opts, "probesize", desc->probesize, 0);
+  }
+  if (desc->analyzeduration) {
+    av_dict_set(&opts, "analyzeduration", desc->analyzeduration, 0);
+  }
+  int res = avformat_open_input(fmt_ctx, path, NULL, &opts);
+  av_dict_free(&opts);
   if (res != 0) {
-    err = "Failed to open video";
-    goto cleanup;
+    return "Failed to open video";
   }
-  if (avformat_find_stream_info(v->fmt_ctx, NULL) < 0) {
-    err = "Failed to find video stream info";
-    goto cleanup;
+  if (avformat_find_stream_info(*fmt_ctx, NULL) < 0) {
+    return "Failed to find video stream info";
+  }
+  return NULL;
+}
+
+// (re)opens the video decoder, codecs that support lowres decode at 1/2^lowres of the size
+static const char* video_opendecoder(Video* v, int lowres) {
+  const VideoProfile* desc = &video_profiles[v->profile];
+  if (v->codec_ctx) {
+    avcodec_free_context(&v->codec_ctx);
+  }
+  const AVCodec* codec = avcodec_find_decoder(v->codec_params->codec_id);
+  if (codec == NULL) {
+    return "Unsupported video codec";
+  }
+  v->codec_ctx = avcodec_alloc_context3(codec);
+  if (v->codec_ctx == NULL) {
+    return "Unsupported video codec context";
+  }
+  if (avcodec_parameters_to_context(v->codec_ctx, v->codec_params) != 0) {
+    return "Failed to setup codec";
+  }
+  v->codec_ctx->thread_count = desc->thread_count;
+  if (desc->thread_type) {
+    v->codec_ctx->thread_type = desc->thread_type;
+  }
+  v->codec_ctx->lowres = lowres;
+  if (avcodec_open2(v->codec_ctx, codec, NULL) < 0) {
+    return "Failed to open codec";
+  }
+  // frames decoded at different sizes are cached separately
+  v->framekey = filecache_hash(&lowres, sizeof(lowres), v->file->key);
+  return NULL;
+}
+
+// the yuv shader + fullscreen quad, shared by every video that converts its frames on the GPU
+typedef struct {
+  bool init, ok;
+  sg_shader shader;
+  sg_pipeline pip;
+  sg_buffer quad;
+} VideoYuvPipeline;
+static VideoYuvPipeline _yuvpipeline;
+
+// makes the yuv pipeline on first use, returns false if the backend can't run it
+static bool video_yuvpipeline(void) {
+  VideoYuvPipeline* p = &_yuvpipeline;
+  if (p->init) {
+    return p->ok;
+  }
+  p->init = true;
+  sg_backend backend = sg_query_backend();
+  const sg_shader_desc* shader_desc = yuv_shader_desc(backend);
+  if (shader_desc == NULL || !sg_query_pixelformat(SG_PIXELFORMAT_R8).filter ||
+      !sg_query_pixelformat(SG_PIXELFORMAT_RG8).filter || !sg_query_pixelformat(SG_PIXELFORMAT_RGBA8).render) {
+    return false;
+  }
+  // GL render targets are stored bottom up, flip the quad so rgb_img samples the same way as the RGBA stream images
+  float v0 = backend == SG_BACKEND_GLCORE33 ? 0.0f : 1.0f, v1 = 1.0f - v0;
+  float quad[] = {-1.0f, -1.0f, 0.0f, v0, 1.0f, -1.0f, 1.0f, v0, -1.0f, 1.0f, 0.0f, v1, 1.0f, 1.0f, 1.0f, v1};
+  p->shader = sg_make_shader(shader_desc);
+  p->quad = sg_make_buffer(&(sg_buffer_desc){.data = SG_RANGE(quad)});
+  p->pip = sg_make_pipeline(&(sg_pipeline_desc){
+      .shader = p->shader,
+      .layout.attrs = {[ATTR_yuv_vs_position].format = SG_VERTEXFORMAT_FLOAT2,
+                       [ATTR_yuv_vs_texcoord0].format = SG_VERTEXFORMAT_FLOAT2},
+      .primitive_type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
+      .depth.pixel_format = SG_PIXELFORMAT_NONE,
+      .colors[0].pixel_format = SG_PIXELFORMAT_RGBA8,
+      .sample_count = 1,
+  });
+  p->ok = sg_query_pipeline_state(p->pip) == SG_RESOURCESTATE_VALID;
+  return p->ok;
+}
+
+static void video_freeplanes(Video* v) {
+  for (int i = 0; i < 3; i++) {
+    sg_destroy_image(v->plane_img[i]);
+    v->plane_img[i] = (sg_image){0};
+  }
+  for (int i = 0; i < VIDEO_TEXTURE_RING; i++) {
+    sg_destroy_pass(v->rgb_pass[i]);
+    sg_destroy_image(v->rgb_img[i]);
+    v->rgb_pass[i] = (sg_pass){0};
+    v->rgb_img[i] = (sg_image){0};
+  }
+  v->plane_layout = VideoLayout_Rgba;
+  v->shown_planes = (VideoPlanes){0};
+}
+
+// the plane textures for a frame at the output size and the render targets they're converted into
+static void video_allocplanes(Video* v, VideoLayout layout) {
+  video_freeplanes(v);
+  bool nv12 = layout == VideoLayout_Nv12;
+  int w = v->out_width, h = v->out_height;
+  int cw = (w + 1) / 2, ch = layout == VideoLayout_Yuv422p ? h : (h + 1) / 2;
+  for (int i = 0; i < (nv12 ? 2 : 3); i++) {
+    v->plane_img[i] = sg_make_image(&(sg_image_desc){
+        .width = i == 0 ? w : cw,
+        .height = i == 0 ? h : ch,
+        .pixel_format = nv12 && i == 1 ? SG_PIXELFORMAT_RG8 : SG_PIXELFORMAT_R8,
+        .usage = SG_USAGE_STREAM,
+        .min_filter = SG_FILTER_LINEAR,
+        .mag_filter = SG_FILTER_LINEAR,
+        .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+    });
+  }
+  for (int i = 0; i < VIDEO_TEXTURE_RING; i++) {
+    v->rgb_img[i] = sg_make_image(&(sg_image_desc){
+        .render_target = true,
+        .width = w,
+        .height = h,
+        .pixel_format = SG_PIXELFORMAT_RGBA8,
+        .sample_count = 1,
+        .min_filter = SG_FILTER_LINEAR,
+        .mag_filter = SG_FILTER_LINEAR,
+        .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+    });
+    v->rgb_pass[i] = sg_make_pass(&(sg_pass_desc){.color_attachments[0].image = v->rgb_img[i]});
+  }
+  v->plane_layout = layout;
+}
+
+static void video_freereverse(Video* v) {
+  for (int i = 0; i < 2 * VIDEO_REVERSE_STACK; i++) {
+    VideoFrame* f = &v->rev_stack[i / VIDEO_REVERSE_STACK][i % VIDEO_REVERSE_STACK];
+    av_free(f->buf);
+    f->buf = NULL;
+  }
+  v->rev_num[0] = v->rev_num[1] = 0;
+  v->rev_filled = v->rev_seeked = false;
+}
+
+// (re)allocates the staging buffers and texture that decoded frames are converted into. a buffer holds an RGBA frame,
+// which is always big enough for the YUV planes too
+static void video_allocoutput(Video* v, int width, int height) {
+  const VideoProfile* desc = &video_profiles[v->profile];
+  v->out_width = width;
+  v->out_height = height;
+  if (desc->staging) {
+    av_free(v->imgbuf);
+    v->imgbuflen = av_image_get_buffer_size(AV_PIX_FMT_RGBA, width, height, 1);
+    v->imgbuf = av_malloc(v->imgbuflen);
+    if (v->frame_rgb == NULL) {
+      v->frame_rgb = av_frame_alloc();
+    }
+    av_image_fill_arrays(v->frame_rgb->data, v->frame_rgb->linesize, v->imgbuf, AV_PIX_FMT_RGBA, width, height, 1);
+    for (int i = 0; v->async && i < VIDEO_RING_SIZE; i++) {
+      VideoFrame* f = &v->ring[i];
+      av_free(f->buf);
+      f->buf = av_malloc(v->imgbuflen);
+      av_image_fill_arrays(f->data, f->linesize, f->buf, AV_PIX_FMT_RGBA, width, height, 1);
+    }
+    video_freereverse(v); // reallocated at the new size when reverse playback next needs them
+  }
+  if (desc->texture) {
+    video_freeplanes(v);
+    for (int i = 0; i < VIDEO_TEXTURE_RING; i++) {
+      sg_destroy_image(v->img[i]);
+      v->img[i] = sg_make_image(&(sg_image_desc){
+          .width = width,
+          .height = height,
+          .pixel_format = SG_PIXELFORMAT_RGBA8,
+          .usage = SG_USAGE_STREAM,
+          .min_filter = SG_FILTER_LINEAR,
+          .mag_filter = SG_FILTER_LINEAR,
+          .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+          .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+      });
+    }
+    v->img_shown = 0;
+    v->img_handedout = false;
+  }
+}
+
+static void video_startdecodethread(Video* v);
+static void video_freestreams(Video* v);
+
+static void video_init(Video* v, const char* path, const VideoOpenParams* p) {
+  v->file = videofile_acquire(path);
+  v->params = *p;
+  v->seek_window_secs = p->seek_window_secs > 0.0 ? p->seek_window_secs : VIDEO_DEFAULT_SEEK_WINDOW_SECS;
+  v->shown_secs = -1.0;
+  v->profile = p->profile;
+}
+
+// opens the demuxer + decoders. touches nothing shared with other videos, so cursors can be opened off the main thread.
+// on an error the video still has to be closed
+static const char* video_openstreams(Video* v, const AVIOInterruptCB* interrupt) {
+  const VideoOpenParams* p = &v->params;
+  const VideoProfile* desc = &video_profiles[p->profile];
+  const char* err = video_openformat(v->file->path, desc, interrupt, &v->fmt_ctx);
+  if (err) {
+    return err;
   }
   v->vidstreamidx = -1;
   v->audiostreamidx = -1;
@@ -193,269 +666,1074 @@ VideoOpenRes video_open(const char* path, const VideoOpenParams* p) {
     if (type == AVMEDIA_TYPE_VIDEO && v->vidstreamidx == -1) {
       v->codec_params = v->fmt_ctx->streams[i]->codecpar;
       v->total_secs = (double)v->fmt_ctx->duration * av_q2d(AV_TIME_BASE_Q);
+      AVRational frame_rate = v->fmt_ctx->streams[i]->avg_frame_rate;
+      v->frame_secs = frame_rate.num && frame_rate.den ? av_q2d(av_inv_q(frame_rate)) : 1.0 / 30.0;
       v->vidstreamidx = i;
     }
-    if (type == AVMEDIA_TYPE_AUDIO && v->audiostreamidx == -1) {
+    if (type == AVMEDIA_TYPE_AUDIO && v->audiostreamidx == -1 && desc->audio && !p->disable_audio) {
       v->audiostreamidx = i;
     }
   }
-  if (v->codec_params == NULL) {
-    err = "Failed to find video stream";
-    goto cleanup;
-  }
-  const AVCodec* codec = avcodec_find_decoder(v->codec_params->codec_id);
-  if (codec == NULL) {
-    err = "Unsupported video codec";
-    goto cleanup;
-  }
-  v->codec_ctx = avcodec_alloc_context3(codec);
-  if (v->codec_ctx == NULL) {
-    err = "Unsupported video codec context";
-    goto cleanup;
+  // the demuxer can skip packets from streams we never read
+  for (int i = 0; i < (int)v->fmt_ctx->nb_streams; i++) {
+    if (i != v->vidstreamidx && i != v->audiostreamidx) {
+      v->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
   }
-  if (avcodec_parameters_to_context(v->codec_ctx, v->codec_params) != 0) {
-    err = "Failed to setup codec";
-    goto cleanup;
+  if (v->codec_params == NULL) {
+    return "Failed to find video stream";
   }
-  // open video codec
-  if (avcodec_open2(v->codec_ctx, codec, NULL) < 0) {
-    err = "Failed to open codec";
-    goto cleanup;
+  err = video_opendecoder(v, 0);
+  if (err) {
+    return err;
   }
   v->frame_raw = av_frame_alloc();
-  v->aud_frame_raw = av_frame_alloc();
-  v->sws_ctx =
-      sws_getContext(v->codec_params->width, v->codec_params->height, v->codec_params->format, v->codec_params->width,
-                     v->codec_params->height, AV_PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
-  v->img = sg_make_image(&(sg_image_desc){
-      .width = v->codec_params->width,
-      .height = v->codec_params->height,
-      .pixel_format = SG_PIXELFORMAT_RGBA8,
-      .usage = SG_USAGE_STREAM,
-      .min_filter = SG_FILTER_LINEAR,
-      .mag_filter = SG_FILTER_LINEAR,
-      .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
-      .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
-  });
-  v->imgbuflen = av_image_get_buffer_size(AV_PIX_FMT_RGBA, v->codec_params->width, v->codec_params->height, 1);
-  v->imgbuf = av_malloc(v->imgbuflen);
-  v->frame_rgb = av_frame_alloc();
-  av_image_fill_arrays(v->frame_rgb->data, v->frame_rgb->linesize, v->imgbuf, AV_PIX_FMT_RGBA, v->codec_params->width,
-                       v->codec_params->height, 1);
-
-  // setup audio track if it exists
-  if (v->audiostreamidx != -1 && !p->disable_audio) {
-    res = avformat_open_input(&v->aud_fmt_ctx, path, NULL, NULL);
-    if (res != 0) {
-      err = "Failed to open video";
-      goto cleanup;
-    }
-    if (avformat_find_stream_info(v->aud_fmt_ctx, NULL) < 0) {
-      err = "Failed to find video stream info";
-      goto cleanup;
-    }
-    v->aud_codec_params = v->aud_fmt_ctx->streams[v->audiostreamidx]->codecpar;
+  v->read_pkt = av_packet_alloc();
+  packet_queue_init(&v->vid_queue, v->fmt_ctx->streams[v->vidstreamidx]->time_base, &p->video_queue,
+                    &video_queue_defaults);
+  // the audio queue stays empty without an audio stream, but its limits still bound video_fillqueues
+  AVRational aud_time_base =
+      v->audiostreamidx != -1 ? v->fmt_ctx->streams[v->audiostreamidx]->time_base : (AVRational){1, 1};
+  packet_queue_init(&v->aud_queue, aud_time_base, &p->audio_queue, &audio_queue_defaults);
+  v->out_div = 1;
+
+  // setup audio track if it exists, its packets come from the same demuxer as the video
+  if (v->audiostreamidx != -1) {
+    v->aud_frame_raw = av_frame_alloc();
+    v->aud_convert = audioconvert_create();
+    v->aud_codec_params = v->fmt_ctx->streams[v->audiostreamidx]->codecpar;
     const AVCodec* aud_codec = avcodec_find_decoder(v->aud_codec_params->codec_id);
     if (aud_codec == NULL) {
-      err = "Unsupported audio codec";
-      goto cleanup;
+      return "Unsupported audio codec";
     }
     v->aud_codec_ctx = avcodec_alloc_context3(aud_codec);
     if (v->aud_codec_ctx == NULL) {
-      err = "Unsupported audio codec context";
-      goto cleanup;
+      return "Unsupported audio codec context";
     }
     if (avcodec_parameters_to_context(v->aud_codec_ctx, v->aud_codec_params) != 0) {
-      err = "Failed to setup audio codec";
-      goto cleanup;
+      return "Failed to setup audio codec";
     }
     if (avcodec_open2(v->aud_codec_ctx, aud_codec, NULL) < 0) {
-      err = "Failed to open audio codec";
-      goto cleanup;
+      return "Failed to open audio codec";
     }
   }
-cleanup:
-  if (err != NULL) {
+  return NULL;
+}
+
+// the textures, the file's caches and the decode thread, on the main thread once the streams are open
+static void video_finishopen(Video* v) {
+  const VideoOpenParams* p = &v->params;
+  const VideoProfile* desc = &video_profiles[p->profile];
+  v->gpu_yuv = desc->texture && video_yuvpipeline();
+  video_allocoutput(v, v->codec_params->width, v->codec_params->height);
+  // the file's caches are started by the first video that needs them, the others reuse them
+  VideoFile* file = v->file;
+  const char* path = file->path;
+  if (file->index == NULL) {
+    file->index = videoindex_open(path, v->vidstreamidx);
+  }
+  v->run_key_pts = AV_NOPTS_VALUE;
+  if (v->audiostreamidx != -1 && p->pcm_cache_rate > 0 && p->pcm_cache_channels > 0) {
+    if (file->pcm == NULL) {
+      file->pcm = pcmcache_open(path, v->audiostreamidx, p->pcm_cache_rate, p->pcm_cache_channels);
+    }
+    v->aud_pcm_rate = p->pcm_cache_rate;
+  }
+  if (v->profile == VideoOpenProfile_Preview && v->audiostreamidx != -1 && file->waveform == NULL) {
+    file->waveform = waveform_open(path, v->audiostreamidx);
+  }
+  if (p->async_decode && desc->staging) {
+    video_startdecodethread(v);
+  }
+}
+
+VideoOpenRes video_open(const char* path, const VideoOpenParams* p) {
+  VideoId vid = _video_alloc();
+  Video* v = _video_at(vid);
+  video_init(v, path, p);
+  const char* err = video_openstreams(v, NULL);
+  if (err) {
     video_close(vid);
     return (VideoOpenRes){.err = err};
   }
+  video_finishopen(v);
   return (VideoOpenRes){.vid = vid};
 }
 
-void video_nextframe(VideoId vid, double pos_secs, thread_mutex_t* aud_thread_mtx) {
+VideoOpenRes video_opencursor(VideoId vid) {
   Video* v = _video_at(vid);
-  double dt = pos_secs - v->pos_secs;
-  v->pos_secs = pos_secs;
-  if (v->pos_secs < 0.0) {
-    v->pos_secs = 0.0;
-  } else if (v->pos_secs > v->total_secs) {
-    v->pos_secs = v->total_secs;
-  }
-  double time_base = av_q2d(av_inv_q(v->fmt_ctx->streams[v->vidstreamidx]->time_base));
-  // apply seeking if required
-  if (dt < 0.0 || dt > 0.01) {
-    packet_queue_clear(&v->vid_queue);
+  return video_open(v->file->path, &v->params);
+}
 
-    thread_mutex_lock(aud_thread_mtx);
-    packet_queue_clear(&v->aud_queue);
-    thread_mutex_unlock(aud_thread_mtx);
+// the streams are opened into a video of its own, which only takes a slot in the pool once they're ready
+struct VideoCursorOpen {
+  Video v;
+  const char* err;
+  thread_ptr_t thread;
+  thread_atomic_int_t done;
+  thread_atomic_int_t cancel;
+};
 
-    int64_t timestamp = (int64_t)((double)v->pos_secs * time_base);
-    av_seek_frame(v->fmt_ctx, v->vidstreamidx, timestamp, AVSEEK_FLAG_BACKWARD);
-    avcodec_flush_buffers(v->codec_ctx);
-    if (v->aud_codec_ctx) {
-      avcodec_flush_buffers(v->aud_codec_ctx);
-    }
-    v->next_swap_secs = 0.0f;
-  }
-  v->aud_playing = dt != 0.0;
-  // fill the packet queues for audio and video from current position
-  AVPacket packet;
-  while ((!packet_queue_full(&v->vid_queue) && !packet_queue_full(&v->aud_queue)) && 
-    (v->vid_queue.num_packets < 8 || v->aud_queue.num_packets < 8) &&
-    av_read_frame(v->fmt_ctx, &packet) >= 0) {
-    if (packet.stream_index == v->vidstreamidx) {
-      packet_queue_put(&v->vid_queue, &packet);
-    } else if (packet.stream_index == v->audiostreamidx) {
-      thread_mutex_lock(aud_thread_mtx);
-      packet_queue_put(&v->aud_queue, &packet);
-      thread_mutex_unlock(aud_thread_mtx);
-    }
-    av_packet_unref(&packet);
-  }
-  // if we need to swap a video frame, decode + present the next frame
-  if (v->pos_secs >= v->next_swap_secs) {
-    while (true) {
-      AVPacket* pkt = packet_queue_pop(&v->vid_queue);
-      if (pkt == NULL) {
-        break;
-      }
-      if (avcodec_send_packet(v->codec_ctx, pkt) < 0) {
-        av_packet_unref(pkt);
-        continue;
-      }
-      if (avcodec_receive_frame(v->codec_ctx, v->frame_raw) < 0) {
-        av_packet_unref(pkt);
-        av_frame_unref(v->frame_raw);
-        continue;
-      }
-      v->next_swap_secs = (double)v->frame_raw->pts / time_base;
-      if (v->next_swap_secs < v->pos_secs) {
-        av_packet_unref(pkt);
-        av_frame_unref(v->frame_raw);
-        continue;
-      }
-      sws_scale(v->sws_ctx, v->frame_raw->data, v->frame_raw->linesize, 0, v->codec_params->height,
-                v->frame_rgb->data, v->frame_rgb->linesize);
-      sg_update_image(v->img, &(sg_image_data){.subimage[0][0] = {.ptr = v->imgbuf, .size = v->imgbuflen}});
+// polled by the demuxer while it probes, so a cancelled open stops reading the file
+static int video_opencursor_interrupt(void* user_data) {
+  VideoCursorOpen* op = (VideoCursorOpen*)user_data;
+  return thread_atomic_int_load(&op->cancel);
+}
 
-      av_packet_unref(pkt);
-      av_frame_unref(v->frame_raw);
-      break;
-    }
-  }
+static int video_opencursor_thread(void* user_data) {
+  VideoCursorOpen* op = (VideoCursorOpen*)user_data;
+  AVIOInterruptCB interrupt = {.callback = video_opencursor_interrupt, .opaque = op};
+  op->err = video_openstreams(&op->v, &interrupt);
+  thread_atomic_int_store(&op->done, 1);
+  return 0;
+}
+
+VideoCursorOpen* video_opencursor_async(VideoId vid) {
+  Video* src = _video_at(vid);
+  VideoCursorOpen* op = (VideoCursorOpen*)calloc(1, sizeof(VideoCursorOpen));
+  assert(op);
+  video_init(&op->v, src->file->path, &src->params);
+  thread_atomic_int_store(&op->done, 0);
+  thread_atomic_int_store(&op->cancel, 0);
+  op->thread = thread_create(video_opencursor_thread, op, "video open", THREAD_STACK_SIZE_DEFAULT);
+  return op;
 }
 
-static int video_appendaudio(AVFrame* aud_frame, float* frames, int* frame_pos, int* num_frames, int num_channels) {
-  int num_samples = aud_frame->nb_samples - *frame_pos;
-  const float* framesl = (float*)aud_frame->data[0];
-  const float* framesr = aud_frame->channels >= 2 ? (float*)aud_frame->data[1] : framesl;
-  if (num_samples > *num_frames) {
-    num_samples = *num_frames;
+bool video_opencursor_ready(VideoCursorOpen* op, VideoOpenRes* res) {
+  if (!thread_atomic_int_load(&op->done)) {
+    return false;
   }
-  if (num_channels >= 2) {
-    for (int i = 0, j = *frame_pos * num_channels; i < num_samples; i++) {
-      frames[j++] = framesl[i];
-      frames[j++] = framesr[i];
-    }
+  thread_join(op->thread);
+  thread_destroy(op->thread);
+  VideoId vid = _video_alloc();
+  Video* v = _video_at(vid);
+  op->v.id = v->id;
+  *v = op->v;
+  if (op->err) {
+    video_close(vid);
+    *res = (VideoOpenRes){.err = op->err};
   } else {
-    for (int i = 0, j = *frame_pos; i < num_samples; i++) {
-      frames[j++] = framesl[i];
-    }
+    video_finishopen(v);
+    *res = (VideoOpenRes){.vid = vid};
   }
-  *frame_pos += num_samples;
-  *num_frames -= num_samples;
-  return num_samples;
+  free(op);
+  return true;
 }
 
-void video_getaudio_underlock(VideoId vid, float* frames, int num_frames, int num_channels, int sample_rate) {
-  Video* v = _video_at(vid);
-  if (v->aud_playing && v->aud_codec_ctx) {
-    AVPacket* pkt = NULL;
-    while (num_frames > 0) {
-      if (v->aud_got_frame) {
-        assert(v->aud_frame_raw->sample_rate == sample_rate);
-        frames += video_appendaudio(v->aud_frame_raw, frames, &v->aud_frame_pos, &num_frames, num_channels) * 2;
-        if (v->aud_frame_pos < v->aud_frame_raw->nb_samples) {
-          break;
-        }
-        av_frame_unref(v->aud_frame_raw);
-        v->aud_got_frame = false;
-      }
-      pkt = packet_queue_pop(&v->aud_queue);
-      if (pkt == NULL) {
-        break;
-      }
-      if (avcodec_send_packet(v->aud_codec_ctx, pkt) < 0) {
-        av_packet_unref(pkt);
-        continue;
-      }
-      if (avcodec_receive_frame(v->aud_codec_ctx, v->aud_frame_raw) >= 0) {
-        v->aud_frame_pos = 0;
-        v->aud_got_frame = true;
-      }
-      av_packet_unref(pkt);
-    }
+// the video never made it into the pool, so only what video_openstreams opened has to go
+void video_opencursor_cancel(VideoCursorOpen* op) {
+  if (op == NULL) {
+    return;
   }
-  if (num_channels >= 2) {
-    for (int i = 0, j = 0; i < num_frames; i++) {
-      frames[j++] = 0.0f;
-      frames[j++] = 0.0f;
-    }
-  } else {
-    for (int i = 0; i < num_frames; i++) {
-      frames[i] = 0.0f;
+  thread_atomic_int_store(&op->cancel, 1);
+  thread_join(op->thread);
+  thread_destroy(op->thread);
+  video_freestreams(&op->v);
+  videofile_release(op->v.file);
+  free(op);
+}
+
+// audio is heard at 1x, and paused while scrubbing. every other shuttle speed plays silence
+static bool video_mutedspeed(double speed) {
+  return speed != 0.0 && speed != 1.0;
+}
+
+// reads the next packet from the demuxer into the audio or video queue, returns false at the end of the file
+static bool video_readpacket(Video* v, thread_mutex_t* aud_thread_mtx) {
+  AVPacket* packet = v->read_pkt;
+  if (av_read_frame(v->fmt_ctx, packet) < 0) {
+    return false;
+  }
+  if (packet->stream_index == v->vidstreamidx) {
+    packet_queue_put(&v->vid_queue, packet);
+  } else if (packet->stream_index == v->audiostreamidx) {
+    thread_mutex_lock(aud_thread_mtx);
+    // all of the audio is dropped once it's read from the cache or while shuttling. otherwise a full queue only drops it
+    // where it won't be heard: decoding forward to a seek target, or while paused. at 1x video_decodeframe waits for it
+    // to drain instead
+    bool dropped = video_mutedspeed(v->decode_speed) ||
+                   (packet_queue_full(&v->aud_queue) && (!v->decode_settled || v->decode_speed != 1.0));
+    if (!dropped && !thread_atomic_int_load(&v->aud_cached)) {
+      packet_queue_put(&v->aud_queue, packet);
     }
+    thread_mutex_unlock(aud_thread_mtx);
   }
+  av_packet_unref(packet); // no-op unless the packet was dropped
+  return true;
 }
 
-void video_close(VideoId vid) {
-  Video* v = _video_lookup(vid);
-  if (v == NULL) {
+// once either queue drops below its low watermark, reads ahead until one of them reaches its high watermark
+static void video_fillqueues(Video* v, thread_mutex_t* aud_thread_mtx) {
+  bool hasaudio =
+      v->audiostreamidx != -1 && !thread_atomic_int_load(&v->aud_cached) && !video_mutedspeed(v->decode_speed);
+  if (!packet_queue_low(&v->vid_queue) && !(hasaudio && packet_queue_low(&v->aud_queue))) {
     return;
   }
-  if (v->frame_raw) {
-    av_frame_free(&v->frame_raw);
-  }
-  if (v->aud_frame_raw) {
-    av_frame_free(&v->aud_frame_raw);
+  while (!packet_queue_full(&v->vid_queue) && !packet_queue_full(&v->aud_queue) &&
+         video_readpacket(v, aud_thread_mtx)) {
   }
-  if (v->frame_rgb) {
-    av_frame_free(&v->frame_rgb);
+}
+
+// seconds count from the start of the stream, its timestamps don't have to begin at 0
+static int64_t video_streamsecstopts(const AVStream* stream, double secs) {
+  int64_t pts = (int64_t)(secs / av_q2d(stream->time_base));
+  return stream->start_time != AV_NOPTS_VALUE ? pts + stream->start_time : pts;
+}
+
+static double video_streamptstosecs(const AVStream* stream, int64_t pts) {
+  if (stream->start_time != AV_NOPTS_VALUE) {
+    pts -= stream->start_time;
   }
-  if (v->sws_ctx) {
-    sws_freeContext(v->sws_ctx);
+  return (double)pts * av_q2d(stream->time_base);
+}
+
+static int64_t video_secstopts(Video* v, double secs) {
+  return video_streamsecstopts(v->fmt_ctx->streams[v->vidstreamidx], secs);
+}
+
+static double video_ptstosecs(Video* v, int64_t pts) {
+  return video_streamptstosecs(v->fmt_ctx->streams[v->vidstreamidx], pts);
+}
+
+// the timestamp to pass to av_seek_frame to be able to decode the frame at pos_secs
+static int64_t video_seektimestamp(Video* v, double pos_secs) {
+  VideoIndexEntry key;
+  if (videoindex_keyframe(v->file->index, video_secstopts(v, pos_secs), &key)) {
+    return key.pts; // lands exactly on the preceding keyframe
   }
-  if (v->fmt_ctx) {
-    avformat_close_input(&v->fmt_ctx);
+  return video_secstopts(v, pos_secs);
+}
+
+// whether it's cheaper to seek than to keep decoding forward from the frame at from_secs to reach to_secs
+static bool video_wantseek(Video* v, double from_secs, double to_secs) {
+  if (to_secs < from_secs) {
+    return true;
   }
-  if (v->codec_ctx) {
-    avcodec_close(v->codec_ctx);
-    avcodec_free_context(&v->codec_ctx);
+  int forward = videoindex_decodecost(v->file->index, video_secstopts(v, from_secs), video_secstopts(v, to_secs));
+  int seek = videoindex_seekcost(v->file->index, video_secstopts(v, to_secs));
+  if (forward >= 0 && seek >= 0) {
+    return forward > seek;
   }
-  if (v->aud_fmt_ctx) {
-    avformat_close_input(&v->aud_fmt_ctx);
+  return to_secs > from_secs + v->seek_window_secs;
+}
+
+static void video_seek(Video* v, double pos_secs, thread_mutex_t* aud_thread_mtx) {
+  packet_queue_clear(&v->vid_queue);
+
+  thread_mutex_lock(aud_thread_mtx);
+  packet_queue_clear(&v->aud_queue);
+  v->aud_gen++;
+  v->aud_got_frame = false;
+  if (v->aud_convert) {
+    audioconvert_reset(v->aud_convert);
+  }
+  thread_mutex_unlock(aud_thread_mtx);
+
+  VideoIndexEntry key;
+  v->run_key_pts = videoindex_keyframe(v->file->index, video_secstopts(v, pos_secs), &key) ? key.pts : AV_NOPTS_VALUE;
+  av_seek_frame(v->fmt_ctx, v->vidstreamidx, video_seektimestamp(v, pos_secs), AVSEEK_FLAG_BACKWARD);
+  avcodec_flush_buffers(v->codec_ctx);
+  v->codec_ctx->skip_frame = AVDISCARD_DEFAULT;
+  v->decode_settled = false;
+  if (v->aud_codec_ctx) {
+    avcodec_flush_buffers(v->aud_codec_ctx);
+  }
+}
+
+// whether playback at 1x has to wait for the audio thread before reading on, the audio queue is full and none of it
+// can be dropped
+static bool video_audiobacklog(Video* v) {
+  return v->audiostreamidx != -1 && v->decode_settled && v->decode_speed == 1.0 &&
+         !thread_atomic_int_load(&v->aud_cached) && packet_queue_full(&v->aud_queue);
+}
+
+// decodes the next video frame into frame_raw, reading more packets as required. returns false at the end of the file,
+// or when the audio queue has to drain before there's room to read on
+static bool video_decodeframe(Video* v, thread_mutex_t* aud_thread_mtx) {
+  while (true) {
+    AVPacket* pkt = packet_queue_pop(&v->vid_queue);
+    if (pkt == NULL) {
+      // decoding forward can run past the queued packets, keep reading until we get a frame
+      if (packet_queue_full(&v->vid_queue) || video_audiobacklog(v) || !video_readpacket(v, aud_thread_mtx)) {
+        return false;
+      }
+      continue;
+    }
+    int res = avcodec_send_packet(v->codec_ctx, pkt);
+    packet_queue_release(&v->vid_queue, pkt);
+    if (res < 0) {
+      continue;
+    }
+    if (avcodec_receive_frame(v->codec_ctx, v->frame_raw) < 0) {
+      av_frame_unref(v->frame_raw);
+      continue;
+    }
+    return true;
+  }
+}
+
+static double video_framesecs(Video* v) {
+  return video_ptstosecs(v, v->frame_raw->pts);
+}
+
+// moves the decoder's frame skipping up or down by how far the frame at pts_secs is behind the playhead, returns how
+// many frames were skipped before it
+static int video_adaptskip(Video* v, double pts_secs, double playhead_secs) {
+  int skipped = 0;
+  if (v->codec_ctx->skip_frame != AVDISCARD_DEFAULT && v->frame_secs > 0.0) {
+    skipped = FFMAX((int)lrint((pts_secs - v->last_decoded_secs) / v->frame_secs) - 1, 0);
+  }
+  v->last_decoded_secs = pts_secs;
+  if (v->profile == VideoOpenProfile_Preview && v->decode_settled) {
+    double lag_secs = playhead_secs - pts_secs;
+    if (lag_secs > VIDEO_SKIP_NONKEY_SECS) {
+      v->codec_ctx->skip_frame = AVDISCARD_NONKEY;
+    } else if (lag_secs > VIDEO_SKIP_NONREF_FRAMES * v->frame_secs && v->codec_ctx->skip_frame < AVDISCARD_NONREF) {
+      v->codec_ctx->skip_frame = AVDISCARD_NONREF;
+    } else if (lag_secs <= 0.0) {
+      v->codec_ctx->skip_frame = AVDISCARD_DEFAULT;
+    }
+  }
+  v->codec_ctx->skip_frame = FFMAX(v->codec_ctx->skip_frame, v->skip_floor);
+  return skipped;
+}
+
+// frames are shown from half a frame before their pts, so each one gets the display refreshes nearest to it and 24p
+// on a 60Hz display settles into an even 3:2 cadence. in reverse that's half a frame after
+static bool video_due(Video* v, double pts_secs) {
+  if (v->req_reverse) {
+    return pts_secs >= v->pos_secs - v->frame_secs * 0.5;
+  }
+  return pts_secs <= v->pos_secs + v->frame_secs * 0.5;
+}
+
+// looks up the frame displayed at pos_secs in the frame cache and references it in frame_raw
+static bool video_cachedframe(Video* v, double pos_secs) {
+  int64_t frame_pts;
+  return videoindex_framepts(v->file->index, video_secstopts(v, pos_secs), &frame_pts) &&
+         framecache_get(v->framekey, frame_pts, v->frame_raw);
+}
+
+// shows the keyframe of the GOP holding pos_secs if it's in the frame cache, as a stand-in until the exact frame has
+// been decoded
+static bool video_cachedkeyframe(Video* v, double pos_secs) {
+  VideoIndexEntry key;
+  return videoindex_keyframe(v->file->index, video_secstopts(v, pos_secs), &key) &&
+         framecache_get(v->framekey, key.pts, v->frame_raw);
+}
+
+// whether the decoder reaches pos_secs by carrying on from where it is: it's decoding the GOP holding pos_secs and
+// hasn't got to it yet. a new target like that doesn't need a seek + flush
+static bool video_decodereaches(Video* v, double pos_secs) {
+  VideoIndexEntry key;
+  return v->run_key_pts != AV_NOPTS_VALUE && videoindex_keyframe(v->file->index, video_secstopts(v, pos_secs), &key) &&
+         key.pts == v->run_key_pts && v->last_decoded_secs < pos_secs - v->frame_secs * 0.5;
+}
+
+// which planes the yuv shader would upload for a frame, and how to turn them into RGB
+static VideoPlanes video_frameplanes(const AVFrame* f) {
+  VideoPlanes planes = {0};
+  switch (f->format) {
+  case AV_PIX_FMT_YUVJ420P:
+    planes.full_range = true; // fallthrough
+  case AV_PIX_FMT_YUV420P:
+    planes.layout = VideoLayout_Yuv420p;
+    break;
+  case AV_PIX_FMT_YUVJ422P:
+    planes.full_range = true; // fallthrough
+  case AV_PIX_FMT_YUV422P:
+    planes.layout = VideoLayout_Yuv422p;
+    break;
+  case AV_PIX_FMT_NV12:
+    planes.layout = VideoLayout_Nv12;
+    break;
+  default:
+    break;
+  }
+  planes.full_range |= f->color_range == AVCOL_RANGE_JPEG;
+  // untagged HD material is almost always BT.709
+  planes.bt709 = f->colorspace == AVCOL_SPC_BT709 || (f->colorspace == AVCOL_SPC_UNSPECIFIED && f->height >= 720);
+  return planes;
+}
+
+// converts frame_raw for display at the output size. 8-bit YUV frames are only packed when the yuv shader can draw
+// them, everything else becomes RGBA. swscale shrinks the YUV planes before converting, so whatever lowres didn't take
+// off is cheap too
+static VideoPlanes video_convertframe(Video* v, uint8_t* data[4], int linesize[4]) {
+  AVFrame* f = v->frame_raw;
+  bool samesize = f->width == v->out_width && f->height == v->out_height;
+  VideoPlanes planes = video_frameplanes(f);
+  if (v->gpu_yuv && samesize && planes.layout != VideoLayout_Rgba) {
+    av_image_copy_to_buffer(data[0], v->imgbuflen, (const uint8_t* const*)f->data, f->linesize, f->format, f->width,
+                            f->height, 1);
+    return planes;
+  }
+  if (samesize && yuvconvert_frame(f, planes.bt709, planes.full_range, data[0], linesize[0])) {
+    return (VideoPlanes){0};
+  }
+  v->sws_ctx = sws_getCachedContext(v->sws_ctx, f->width, f->height, f->format, v->out_width, v->out_height,
+                                    AV_PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
+  sws_scale(v->sws_ctx, (const uint8_t* const*)f->data, f->linesize, 0, f->height, data, linesize);
+  return (VideoPlanes){0};
+}
+
+// starts reverse playback over from the frame at pos_secs
+static void video_reversereset(Video* v, double pos_secs) {
+  v->rev_num[0] = v->rev_num[1] = 0;
+  v->rev_end_secs = pos_secs + v->frame_secs * 0.5;
+  v->rev_seek_secs = -1.0;
+  v->rev_seeked = v->rev_filled = v->rev_atstart = false;
+}
+
+// where to seek to decode the frames just before end_secs: the keyframe they depend on, or a guess until the index is
+// ready. always lands before end_secs
+static double video_reverseseeksecs(Video* v, double end_secs) {
+  VideoIndexEntry key;
+  if (videoindex_keyframe(v->file->index, video_secstopts(v, end_secs) - 1, &key) &&
+      video_ptstosecs(v, key.pts) < end_secs) {
+    return video_ptstosecs(v, key.pts);
+  }
+  return end_secs - VIDEO_REVERSE_FALLBACK_SECS;
+}
+
+// decodes the next frame of the back stack's segment. a GOP longer than the stack only keeps its newest frames, the
+// older ones are decoded again for the next segment. keyframe-only shuttling stops at the first frame
+static void video_reversefill(Video* v, bool keyonly, thread_mutex_t* aud_thread_mtx) {
+  int back = !v->rev_front;
+  VideoFrame* stack = v->rev_stack[back];
+  if (!v->rev_seeked) {
+    if (v->rev_seek_secs < 0.0) {
+      v->rev_seek_secs = video_reverseseeksecs(v, v->rev_end_secs);
+    }
+    video_seek(v, FFMAX(v->rev_seek_secs, 0.0), aud_thread_mtx);
+    v->codec_ctx->skip_frame = keyonly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    v->rev_seeked = true;
+    thread_mutex_lock(&v->decode_mtx);
+    v->stats.seeks++;
+    thread_mutex_unlock(&v->decode_mtx);
+  }
+  bool gotframe = video_decodeframe(v, aud_thread_mtx);
+  if (gotframe && video_framesecs(v) < v->rev_end_secs - v->frame_secs * 0.25) {
+    if (v->rev_num[back] == VIDEO_REVERSE_STACK) {
+      VideoFrame oldest = stack[0];
+      memmove(stack, stack + 1, sizeof(VideoFrame) * (VIDEO_REVERSE_STACK - 1));
+      stack[VIDEO_REVERSE_STACK - 1] = oldest;
+      v->rev_num[back]--;
+    }
+    VideoFrame* f = &stack[v->rev_num[back]++];
+    if (f->buf == NULL) {
+      f->buf = av_malloc(v->imgbuflen);
+      av_image_fill_arrays(f->data, f->linesize, f->buf, AV_PIX_FMT_RGBA, v->out_width, v->out_height, 1);
+    }
+    f->planes = video_convertframe(v, f->data, f->linesize);
+    f->pts_secs = video_framesecs(v);
+    f->preview = false;
+    v->last_decoded_secs = f->pts_secs;
+    framecache_put(v->framekey, v->frame_raw->pts, v->frame_raw); // frame steps back are served from the cache
+    av_frame_unref(v->frame_raw);
+    if (!keyonly) {
+      return;
+    }
+  } else if (gotframe) {
+    av_frame_unref(v->frame_raw);
+  }
+  // the segment is complete: decoding reached the frames already handed out, or the end of the file
+  v->rev_seeked = false;
+  if (v->rev_num[back] > 0) {
+    v->rev_filled = true;
+    v->rev_end_secs = stack[0].pts_secs;
+    v->rev_seek_secs = -1.0;
+  } else if (v->rev_seek_secs <= 0.0) {
+    v->rev_atstart = true;
+  } else {
+    // the seek landed after the frames we wanted, go back a keyframe further
+    v->rev_seek_secs = video_reverseseeksecs(v, v->rev_seek_secs);
+  }
+}
+
+// one step of reverse playback: hands the newest frame of the front stack to the ring when there's space, otherwise
+// decodes ahead into the back stack. frames the playhead has already passed are dropped. returns false when there's
+// nothing to do until the ring drains or a new request comes in
+static bool video_reversestep(Video* v, VideoFrame* slot, bool ring_full, int gen, double req_pos_secs, bool keyonly,
+                              thread_mutex_t* aud_thread_mtx) {
+  if (v->rev_num[v->rev_front] == 0 && v->rev_filled) {
+    v->rev_front = !v->rev_front;
+    v->rev_filled = false;
+  }
+  int front = v->rev_front;
+  if (v->rev_num[front] > 0 && !ring_full) {
+    VideoFrame* f = &v->rev_stack[front][--v->rev_num[front]];
+    bool passed = f->pts_secs > req_pos_secs + v->frame_secs * 0.5;
+    if (!passed) {
+      VideoFrame handout = *f;
+      *f = *slot; // the slot's buffer goes back on the stack
+      *slot = handout;
+      slot->gen = gen;
+    }
+    thread_mutex_lock(&v->decode_mtx);
+    v->stats.frames_dropped += passed;
+    if (!passed && v->req_gen == gen) {
+      v->decoded_secs = slot->pts_secs;
+      v->ring_num++;
+    }
+    thread_mutex_unlock(&v->decode_mtx);
+    return true;
+  }
+  if (!v->rev_filled && !v->rev_atstart) {
+    video_reversefill(v, keyonly, aud_thread_mtx);
+    return true;
+  }
+  return false;
+}
+
+static int video_decode_thread(void* user_data) {
+  Video* v = (Video*)user_data;
+  int gen = 0;
+  bool seek_pending = false, preview_pending = false;
+  while (thread_atomic_int_load(&v->decode_exit) == 0) {
+    thread_mutex_lock(&v->decode_mtx);
+    int req_gen = v->req_gen;
+    double req_pos_secs = v->req_pos_secs, req_speed = v->req_speed;
+    bool reverse = v->req_reverse, keyonly = v->req_keyonly;
+    thread_mutex_t* aud_thread_mtx = v->aud_thread_mtx;
+    if (req_gen != gen) {
+      v->ring_num = 0;
+    }
+    bool ring_full = v->ring_num >= VIDEO_RING_SIZE;
+    // the slot after the newest frame isn't visible to the main thread until ring_num is bumped
+    VideoFrame* slot = &v->ring[(v->ring_head + v->ring_num) % VIDEO_RING_SIZE];
+    thread_mutex_unlock(&v->decode_mtx);
+    // wait for the first request (which tells us which audio lock to use)
+    if (aud_thread_mtx == NULL) {
+      thread_signal_wait(&v->decode_signal, 100);
+      continue;
+    }
+    // reverse keeps decoding into its back stack while the ring is full
+    if (reverse) {
+      thread_mutex_lock(&v->codec_mtx);
+      v->decode_speed = req_speed;
+      if (req_gen != gen) {
+        gen = req_gen;
+        video_reversereset(v, req_pos_secs);
+      }
+      bool busy = video_reversestep(v, slot, ring_full, gen, req_pos_secs, keyonly, aud_thread_mtx);
+      thread_mutex_unlock(&v->codec_mtx);
+      if (!busy) {
+        thread_signal_wait(&v->decode_signal, 100);
+      }
+      continue;
+    }
+    // wait for space in the ring
+    if (ring_full) {
+      thread_signal_wait(&v->decode_signal, 100);
+      continue;
+    }
+
+    thread_mutex_lock(&v->codec_mtx);
+    v->skip_floor = keyonly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    v->decode_speed = req_speed;
+    // after a jump show the cached frame straight away, or failing that the GOP's cached keyframe, then seek to start
+    // decoding ahead of it. only the newest request counts, whatever an older one was still decoding is dropped
+    bool didseek = false, cached = false, catchup = false;
+    if (req_gen != gen) {
+      gen = req_gen;
+      preview_pending = true;
+      seek_pending = !video_decodereaches(v, req_pos_secs);
+      cached = video_cachedframe(v, req_pos_secs) || (seek_pending && video_cachedkeyframe(v, req_pos_secs));
+      catchup = !cached && !seek_pending; // the jump is reached by decoding on through the GOP
+    }
+    if (!cached && seek_pending) {
+      video_seek(v, req_pos_secs, aud_thread_mtx);
+      seek_pending = false;
+      didseek = true;
+    }
+    if (!cached) {
+      video_fillqueues(v, aud_thread_mtx);
+    }
+    bool gotframe = cached || video_decodeframe(v, aud_thread_mtx);
+    double pts_secs = gotframe ? video_framesecs(v) : 0.0;
+    int skipped = gotframe && !cached ? video_adaptskip(v, pts_secs, req_pos_secs) : 0;
+    // don't bother converting frames that are already behind the playhead, except for the first one after a jump
+    bool preview = gotframe && pts_secs + v->frame_secs <= req_pos_secs;
+    bool wantframe = gotframe && (!preview || preview_pending);
+    v->decode_settled |= wantframe && !preview;
+    preview_pending &= !wantframe;
+    if (wantframe) {
+      slot->planes = video_convertframe(v, slot->data, slot->linesize);
+      slot->preview = preview;
+      if (!cached) {
+        framecache_put(v->framekey, v->frame_raw->pts, v->frame_raw);
+      }
+    }
+    av_frame_unref(v->frame_raw);
+    thread_mutex_unlock(&v->codec_mtx);
+
+    thread_mutex_lock(&v->decode_mtx);
+    v->stats.seeks += didseek;
+    v->stats.forward_decodes += catchup;
+    v->stats.frames_skipped += skipped;
+    if (gotframe && v->req_gen == gen) {
+      v->decoded_secs = pts_secs;
+      if (wantframe) {
+        slot->pts_secs = pts_secs;
+        slot->gen = gen;
+        v->ring_num++;
+      } else {
+        v->stats.frames_dropped += v->decode_settled;
+      }
+    }
+    thread_mutex_unlock(&v->decode_mtx);
+    if (!gotframe) {
+      // end of the file or a full audio queue, wait for a new request or for the audio to drain
+      thread_signal_wait(&v->decode_signal, 100);
+    }
+  }
+  return 0;
+}
+
+static void video_startdecodethread(Video* v) {
+  for (int i = 0; i < VIDEO_RING_SIZE; i++) {
+    VideoFrame* f = &v->ring[i];
+    f->buf = av_malloc(v->imgbuflen);
+    av_image_fill_arrays(f->data, f->linesize, f->buf, AV_PIX_FMT_RGBA, v->out_width, v->out_height, 1);
+  }
+  thread_mutex_init(&v->codec_mtx);
+  thread_mutex_init(&v->decode_mtx);
+  thread_signal_init(&v->decode_signal);
+  thread_atomic_int_store(&v->decode_exit, 0);
+  v->async = true;
+  v->decode_thread = thread_create(video_decode_thread, v, "video decode", THREAD_STACK_SIZE_DEFAULT);
+}
+
+static void video_stopdecodethread(Video* v) {
+  if (!v->async) {
+    return;
+  }
+  thread_atomic_int_store(&v->decode_exit, 1);
+  thread_signal_raise(&v->decode_signal);
+  thread_join(v->decode_thread);
+  thread_destroy(v->decode_thread);
+  thread_signal_term(&v->decode_signal);
+  thread_mutex_term(&v->decode_mtx);
+  thread_mutex_term(&v->codec_mtx);
+  for (int i = 0; i < VIDEO_RING_SIZE; i++) {
+    av_free(v->ring[i].buf);
+    v->ring[i].buf = NULL;
+  }
+  video_freereverse(v);
+  v->async = false;
+}
+
+// the yuv shader's matrix for BT.601 or BT.709, limited range is stretched from 16..235 (luma) and 16..240 (chroma)
+static yuv_fs_params_t video_yuvparams(VideoPlanes planes) {
+  float kr = planes.bt709 ? 0.2126f : 0.299f, kb = planes.bt709 ? 0.0722f : 0.114f, kg = 1.0f - kr - kb;
+  float ys = planes.full_range ? 1.0f : 255.0f / 219.0f, cs = planes.full_range ? 1.0f : 255.0f / 224.0f;
+  return (yuv_fs_params_t){
+      .coeff_r = {ys, 0.0f, 2.0f * (1.0f - kr) * cs},
+      .coeff_g = {ys, -2.0f * kb * (1.0f - kb) / kg * cs, -2.0f * kr * (1.0f - kr) / kg * cs},
+      .coeff_b = {ys, 2.0f * (1.0f - kb) * cs, 0.0f},
+      .offset = {planes.full_range ? 0.0f : 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f,
+                 planes.layout == VideoLayout_Nv12 ? 1.0f : 0.0f},
+  };
+}
+
+// uploads the planes packed by video_convertframe and converts them into rgb_img[slot] with an offscreen pass
+static void video_uploadplanes(Video* v, int slot, uint8_t* buf, VideoPlanes planes) {
+  if (v->plane_layout != planes.layout) {
+    video_allocplanes(v, planes.layout);
+  }
+  bool nv12 = planes.layout == VideoLayout_Nv12;
+  int w = v->out_width, h = v->out_height;
+  int cw = (w + 1) / 2, ch = planes.layout == VideoLayout_Yuv422p ? h : (h + 1) / 2;
+  size_t ysize = (size_t)w * h, csize = (size_t)cw * ch * (nv12 ? 2 : 1);
+  sg_update_image(v->plane_img[0], &(sg_image_data){.subimage[0][0] = {.ptr = buf, .size = ysize}});
+  sg_update_image(v->plane_img[1], &(sg_image_data){.subimage[0][0] = {.ptr = buf + ysize, .size = csize}});
+  if (!nv12) {
+    sg_update_image(v->plane_img[2], &(sg_image_data){.subimage[0][0] = {.ptr = buf + ysize + csize, .size = csize}});
+  }
+  yuv_fs_params_t params = video_yuvparams(planes);
+  sg_begin_pass(v->rgb_pass[slot], &(sg_pass_action){.colors[0].action = SG_ACTION_DONTCARE});
+  sg_apply_pipeline(_yuvpipeline.pip);
+  sg_apply_bindings(&(sg_bindings){
+      .vertex_buffers[0] = _yuvpipeline.quad,
+      .fs_images = {[SLOT_yuv_tex_y] = v->plane_img[0],
+                    [SLOT_yuv_tex_u] = v->plane_img[1],
+                    [SLOT_yuv_tex_v] = v->plane_img[nv12 ? 1 : 2]}, // NV12 has nothing in tex_v
+  });
+  sg_apply_uniforms(SG_SHADERSTAGE_FS, SLOT_yuv_fs_params, &SG_RANGE(params));
+  sg_draw(0, 4, 1);
+  sg_end_pass();
+}
+
+// writes the frame into the next slot of the texture ring and makes it the shown one. export videos have no texture,
+// their frames stay in the staging buffers
+static void video_upload(Video* v, uint8_t* buf, VideoPlanes planes) {
+  if (v->img[0].id == 0) {
+    return;
+  }
+  int slot = (v->img_shown + 1) % VIDEO_TEXTURE_RING;
+  if (planes.layout != VideoLayout_Rgba) {
+    video_uploadplanes(v, slot, buf, planes);
+  } else {
+    sg_update_image(v->img[slot], &(sg_image_data){.subimage[0][0] = {.ptr = buf, .size = v->imgbuflen}});
+  }
+  // with a single texture this upload would have had to wait for the GPU to finish drawing the shown frame
+  v->stats.upload_stalls_avoided += v->img_handedout;
+  v->img_shown = slot;
+  v->img_handedout = false;
+  v->shown_planes = planes;
+}
+
+// times the first image and the exact frame after a jump, up to the upload in the frame they're drawn in
+static void video_scrubshown(Video* v, const VideoFrame* f) {
+  if (!v->scrub_pending || f->gen != v->scrub_gen) {
+    return;
+  }
+  double secs = stm_sec(stm_since(v->scrub_start));
+  if (!v->scrub_previewed) {
+    v->scrub_previewed = true;
+    v->stats.scrub_preview_secs = secs;
+  }
+  if (!f->preview) {
+    v->scrub_pending = false;
+    v->stats.scrubs++;
+    v->stats.scrub_latency_secs = secs;
+    v->stats.scrub_latency_max_secs = FFMAX(v->stats.scrub_latency_max_secs, secs);
+  }
+}
+
+// posts the new position to the decode thread and uploads the newest frame that's due
+static void video_nextframe_async(Video* v, double dt, thread_mutex_t* aud_thread_mtx) {
+  thread_mutex_lock(&v->decode_mtx);
+  if (v->prefetch_pending) {
+    dt = v->pos_secs - v->req_pos_secs;
+    v->prefetch_pending = false;
+  }
+  v->aud_thread_mtx = aud_thread_mtx;
+  v->req_pos_secs = v->pos_secs;
+  v->req_speed = v->shuttle;
+  // reverse playback decodes backwards through the GOPs from where it is, only jumps restart it
+  bool reverse = v->shuttle < 0.0;
+  bool jumped = reverse ? dt > 0.0 || dt < -VIDEO_REVERSE_JUMP_SECS
+                        : dt < 0.0 || video_wantseek(v, v->decoded_secs, v->pos_secs);
+  bool restart = v->needs_seek || jumped || reverse != v->req_reverse;
+  // a jump forward that's short enough is decoded through by the current request
+  v->stats.forward_decodes += !restart && !reverse && dt > 0.1;
+  if (restart) {
+    v->req_gen++;
+    v->decoded_secs = v->pos_secs;
+    v->needs_seek = false;
+    v->scrub_start = stm_now();
+    v->scrub_gen = v->req_gen;
+    v->scrub_pending = true;
+    v->scrub_previewed = false;
+  }
+  v->req_reverse = reverse;
+  v->req_keyonly = fabs(v->shuttle) >= VIDEO_SHUTTLE_KEYONLY_SPEED;
+  // drop frames from old requests and frames that have already been replaced by a newer one
+  while (v->ring_num > 0) {
+    VideoFrame* head = &v->ring[v->ring_head];
+    VideoFrame* next = &v->ring[(v->ring_head + 1) % VIDEO_RING_SIZE];
+    if (head->gen == v->req_gen && (v->ring_num < 2 || !video_due(v, next->pts_secs))) {
+      break;
+    }
+    v->stats.frames_dropped += head->gen == v->req_gen && head->pts_secs != v->shown_secs && !head->preview;
+    v->ring_head = (v->ring_head + 1) % VIDEO_RING_SIZE;
+    v->ring_num--;
+  }
+  if (v->ring_num > 0) {
+    VideoFrame* head = &v->ring[v->ring_head];
+    if (head->pts_secs != v->shown_secs && video_due(v, head->pts_secs)) {
+      double behind = v->req_reverse ? head->pts_secs - v->pos_secs : v->pos_secs - head->pts_secs;
+      v->stats.frames_late += !v->req_keyonly && !head->preview && behind > v->frame_secs;
+      video_upload(v, head->buf, head->planes);
+      video_scrubshown(v, head);
+      v->shown_secs = head->pts_secs;
+      v->stats.frames_shown++;
+    }
+  }
+  thread_mutex_unlock(&v->decode_mtx);
+  thread_signal_raise(&v->decode_signal);
+}
+
+// switches the audio over to the pcm cache once it's ready and keeps its read position with the playhead. jumps restart
+// the audio right at the new position, without waiting on a seek or the decoder
+static void video_pcmsync(Video* v, double dt, thread_mutex_t* aud_thread_mtx) {
+  if (v->aud_pcm_rate == 0 || !pcmcache_ready(v->file->pcm)) {
+    return;
+  }
+  thread_mutex_lock(aud_thread_mtx);
+  int64_t pos = (int64_t)(v->pos_secs * v->aud_pcm_rate);
+  bool jumped = dt < 0.0 || dt > 0.1 || !thread_atomic_int_load(&v->aud_cached);
+  bool drifted = llabs(v->aud_pcm_pos - pos) > (int64_t)(VIDEO_PCM_RESYNC_SECS * v->aud_pcm_rate);
+  if (!thread_atomic_int_load(&v->aud_cached)) {
+    packet_queue_clear(&v->aud_queue);
+    thread_atomic_int_store(&v->aud_cached, 1);
+  }
+  if (jumped || (dt > 0.0 && drifted)) {
+    v->aud_pcm_pos = pos;
+    v->aud_gen++;
+  }
+  if (jumped) {
+    v->aud_grain_pos = 0;
+    v->aud_grain_frames = (int)(VIDEO_PCM_GRAIN_SECS * v->aud_pcm_rate);
+  } else if (dt > 0.0) {
+    v->aud_grain_frames = 0;
+  }
+  thread_mutex_unlock(aud_thread_mtx);
+}
+
+// stops the audio thread decoding while shuttling. what's queued is thrown away, so coming back to 1x starts the audio
+// from the packets read after that
+static void video_setmuted(Video* v, bool muted, thread_mutex_t* aud_thread_mtx) {
+  if (muted == v->aud_muted) {
+    return;
+  }
+  thread_mutex_lock(aud_thread_mtx);
+  v->aud_muted = muted;
+  if (muted) {
+    packet_queue_clear(&v->aud_queue);
+    v->aud_gen++;
+    v->aud_got_frame = false;
+    if (v->aud_convert) {
+      audioconvert_reset(v->aud_convert);
+    }
+    if (v->aud_codec_ctx) {
+      avcodec_flush_buffers(v->aud_codec_ctx);
+    }
+  }
+  thread_mutex_unlock(aud_thread_mtx);
+}
+
+void video_nextframe(VideoId vid, double pos_secs, thread_mutex_t* aud_thread_mtx) {
+  Video* v = _video_at(vid);
+  if (v->imgbuf == NULL) {
+    return; // probe + thumbnail videos can't be played
+  }
+  double dt = pos_secs - v->pos_secs;
+  v->pos_secs = pos_secs;
+  if (v->pos_secs < 0.0) {
+    v->pos_secs = 0.0;
+  } else if (v->pos_secs > v->total_secs) {
+    v->pos_secs = v->total_secs;
+  }
+  v->aud_playing = dt != 0.0;
+  video_setmuted(v, video_mutedspeed(v->shuttle), aud_thread_mtx);
+  video_pcmsync(v, dt, aud_thread_mtx);
+  if (v->async) {
+    video_nextframe_async(v, dt, aud_thread_mtx);
+    return;
+  }
+  v->decode_speed = v->shuttle;
+  // only seek on backward jumps or when it's cheaper than decoding forward, otherwise keep decoding from here
+  if (v->needs_seek || dt < 0.0 || video_wantseek(v, v->next_swap_secs, v->pos_secs)) {
+    // scrubbing over frames we've already decoded doesn't need the decoder at all
+    bool jumped = dt < 0.0 || dt > 0.1;
+    if (jumped && video_cachedframe(v, v->pos_secs)) {
+      double pts_secs = video_framesecs(v);
+      if (pts_secs != v->shown_secs) {
+        VideoPlanes planes = video_convertframe(v, v->frame_rgb->data, v->frame_rgb->linesize);
+        video_upload(v, v->imgbuf, planes);
+        v->shown_secs = pts_secs;
+        v->stats.frames_shown++;
+      }
+      av_frame_unref(v->frame_raw);
+      v->next_swap_secs = pts_secs + v->frame_secs;
+      v->needs_seek = true; // the decoder is still wherever it was
+      return;
+    }
+    video_seek(v, v->pos_secs, aud_thread_mtx);
+    v->next_swap_secs = 0.0f;
+    v->needs_seek = false;
+    v->stats.seeks++;
+  } else if (dt > 0.1) {
+    // skipping forward without seeking: the queued audio is now stale, and so is whatever's read up to the new position
+    v->stats.forward_decodes++;
+    v->decode_settled = false;
+    thread_mutex_lock(aud_thread_mtx);
+    packet_queue_clear(&v->aud_queue);
+    v->aud_gen++;
+    v->aud_got_frame = false;
+    if (v->aud_convert) {
+      audioconvert_reset(v->aud_convert);
+    }
+    thread_mutex_unlock(aud_thread_mtx);
+    if (v->aud_codec_ctx) {
+      avcodec_flush_buffers(v->aud_codec_ctx);
+    }
+  }
+  // fill the packet queues for audio and video from current position
+  video_fillqueues(v, aud_thread_mtx);
+  // if we need to swap a video frame, decode + present the next frame
+  if (v->pos_secs >= v->next_swap_secs) {
+    while (video_decodeframe(v, aud_thread_mtx)) {
+      v->next_swap_secs = video_framesecs(v);
+      v->stats.frames_skipped += video_adaptskip(v, v->next_swap_secs, v->pos_secs);
+      if (v->next_swap_secs < v->pos_secs) {
+        v->stats.frames_dropped += v->decode_settled;
+        av_frame_unref(v->frame_raw);
+        continue;
+      }
+      v->decode_settled = true;
+      VideoPlanes planes = video_convertframe(v, v->frame_rgb->data, v->frame_rgb->linesize);
+      video_upload(v, v->imgbuf, planes);
+      v->shown_secs = v->next_swap_secs;
+      v->stats.frames_shown++;
+      framecache_put(v->framekey, v->frame_raw->pts, v->frame_raw);
+      av_frame_unref(v->frame_raw);
+      break;
+    }
+  }
+}
+
+void video_prefetch(VideoId vid, double pos_secs, double speed, thread_mutex_t* aud_thread_mtx) {
+  Video* v = _video_at(vid);
+  if (!v->async) {
+    return;
+  }
+  pos_secs = FFMIN(FFMAX(pos_secs, 0.0), v->total_secs);
+  // called every frame until the playhead gets there, only the first call posts a request. the position + shuttle
+  // speed belong to playback and are left alone, the request keeps its own
+  double at_secs = v->prefetch_pending ? v->req_pos_secs : v->pos_secs;
+  double at_speed = v->prefetch_pending ? v->req_speed : v->shuttle;
+  if (fabs(pos_secs - at_secs) < v->frame_secs * 0.5 && at_speed == speed && !v->needs_seek) {
+    return;
+  }
+  v->prefetch_pending = true;
+  thread_mutex_lock(&v->decode_mtx);
+  v->aud_thread_mtx = aud_thread_mtx;
+  v->req_pos_secs = pos_secs;
+  v->req_speed = speed;
+  v->req_gen++;
+  v->decoded_secs = pos_secs;
+  v->needs_seek = false;
+  v->req_reverse = speed < 0.0;
+  v->req_keyonly = fabs(speed) >= VIDEO_SHUTTLE_KEYONLY_SPEED;
+  thread_mutex_unlock(&v->decode_mtx);
+  thread_signal_raise(&v->decode_signal);
+}
+
+int video_audiogen_underlock(VideoId vid) {
+  return _video_at(vid)->aud_gen;
+}
+
+// reads the next block from the pcm cache, a grain stops after aud_grain_frames and fades in + out so it doesn't click
+static int video_getcachedaudio(Video* v, float* frames, int num_frames, int num_channels) {
+  int num = num_frames;
+  if (v->aud_grain_frames > 0) {
+    num = FFMIN(num, v->aud_grain_frames - v->aud_grain_pos);
+  }
+  if (num <= 0) {
+    return 0;
+  }
+  pcmcache_read(v->file->pcm, v->aud_pcm_pos, frames, num);
+  if (v->aud_grain_frames > 0) {
+    int fade = FFMIN(VIDEO_PCM_GRAIN_FADE_FRAMES, v->aud_grain_frames / 2);
+    for (int i = 0; i < num; i++) {
+      int at = v->aud_grain_pos + i, left = v->aud_grain_frames - at;
+      float g = at < fade ? (float)at / fade : (left < fade ? (float)left / fade : 1.0f);
+      for (int c = 0; c < num_channels; c++) {
+        frames[i * num_channels + c] *= g;
+      }
+    }
+    v->aud_grain_pos += num;
+  }
+  v->aud_pcm_pos += num;
+  return num;
+}
+
+void video_getaudio_underlock(VideoId vid, float* frames, int num_frames, int num_channels, int sample_rate) {
+  Video* v = _video_at(vid);
+  bool playing = v->aud_playing && !v->aud_muted;
+  if (playing && thread_atomic_int_load(&v->aud_cached) && pcmcache_matches(v->file->pcm, sample_rate, num_channels)) {
+    int num = video_getcachedaudio(v, frames, num_frames, num_channels);
+    frames += num * num_channels;
+    num_frames -= num;
+  } else if (playing && v->aud_codec_ctx && !thread_atomic_int_load(&v->aud_cached)) {
+    AVPacket* pkt = NULL;
+    while (num_frames > 0) {
+      if (v->aud_got_frame) {
+        int num = FFMIN(v->aud_pcm_frames - v->aud_frame_pos, num_frames);
+        memcpy(frames, v->aud_pcm + v->aud_frame_pos * num_channels, sizeof(float) * num * num_channels);
+        frames += num * num_channels;
+        num_frames -= num;
+        v->aud_frame_pos += num;
+        if (v->aud_frame_pos < v->aud_pcm_frames) {
+          break;
+        }
+        v->aud_got_frame = false;
+      }
+      pkt = packet_queue_pop(&v->aud_queue);
+      if (pkt == NULL) {
+        break;
+      }
+      if (avcodec_send_packet(v->aud_codec_ctx, pkt) < 0) {
+        packet_queue_release(&v->aud_queue, pkt);
+        continue;
+      }
+      if (avcodec_receive_frame(v->aud_codec_ctx, v->aud_frame_raw) >= 0) {
+        v->aud_pcm_frames =
+            audioconvert_frame(v->aud_convert, v->aud_frame_raw, sample_rate, num_channels, &v->aud_pcm);
+        av_frame_unref(v->aud_frame_raw);
+        v->aud_frame_pos = 0;
+        v->aud_got_frame = v->aud_pcm_frames > 0;
+      }
+      packet_queue_release(&v->aud_queue, pkt);
+    }
+  }
+  memset(frames, 0, sizeof(float) * num_frames * num_channels);
+}
+
+// what video_openstreams opened, which is all a video has until video_finishopen
+static void video_freestreams(Video* v) {
+  if (v->frame_raw) {
+    av_frame_free(&v->frame_raw);
+  }
+  if (v->aud_frame_raw) {
+    av_frame_free(&v->aud_frame_raw);
+  }
+  audioconvert_free(v->aud_convert);
+  if (v->fmt_ctx) {
+    avformat_close_input(&v->fmt_ctx);
+  }
+  if (v->codec_ctx) {
+    avcodec_free_context(&v->codec_ctx);
   }
   if (v->aud_codec_ctx) {
     avcodec_close(v->aud_codec_ctx);
     avcodec_free_context(&v->aud_codec_ctx);
   }
-  sg_destroy_image(v->img);
+  packet_queue_free(&v->aud_queue);
+  packet_queue_free(&v->vid_queue);
+  if (v->read_pkt) {
+    av_packet_free(&v->read_pkt);
+  }
+}
+
+void video_close(VideoId vid) {
+  Video* v = _video_lookup(vid);
+  if (v == NULL) {
+    return;
+  }
+  video_stopdecodethread(v);
+  videofile_release(v->file);
+  video_freestreams(v);
+  if (v->frame_rgb) {
+    av_frame_free(&v->frame_rgb);
+  }
+  if (v->sws_ctx) {
+    sws_freeContext(v->sws_ctx);
+  }
+  // only profiles with a texture ever make images, the others can be used without sokol set up
+  if (video_profiles[v->profile].texture) {
+    video_freeplanes(v);
+    for (int i = 0; i < VIDEO_TEXTURE_RING; i++) {
+      sg_destroy_image(v->img[i]);
+    }
+  }
   if (v->imgbuf) {
     av_free(v->imgbuf);
   }
-  packet_queue_clear(&v->aud_queue);
-  packet_queue_clear(&v->vid_queue);
   _video_free(vid);
 }
 
@@ -478,12 +1756,103 @@ void video_gc_sweep(void) {
   }
 }
 
+void videopool_shutdown(void) {
+  VideoPool* p = &_videos;
+  for (int i = 0; i < p->size; i++) {
+    if (p->videos[i].id) {
+      video_close((VideoId){.id = p->videos[i].id});
+    }
+  }
+  // with the decode threads gone nothing puts frames in the cache any more
+  framecache_shutdown();
+}
+
+#define VIDEO_MAX_PREVIEW_DIV (8)
+
+// the fraction of the full size that's used to preview the video in a panel_width x panel_height panel
+static int video_previewdiv(Video* v, VideoPreviewRes res, int panel_width, int panel_height) {
+  int w = v->codec_params->width, h = v->codec_params->height;
+  switch (res) {
+  case VideoPreviewRes_Full:
+    return 1;
+  case VideoPreviewRes_Half:
+    return 2;
+  case VideoPreviewRes_Quarter:
+    return 4;
+  default:
+    break;
+  }
+  int div = 1;
+  while (div < VIDEO_MAX_PREVIEW_DIV && w / (div * 2) >= panel_width && h / (div * 2) >= panel_height) {
+    div *= 2;
+  }
+  // only shrink once the panel is well inside the smaller size, so resizing around a boundary doesn't keep flipping
+  while (div > v->out_div && (w / div < panel_width * 6 / 5 || h / div < panel_height * 6 / 5)) {
+    div /= 2;
+  }
+  return div;
+}
+
+void video_setpreviewres(VideoId vid, VideoPreviewRes res, int panel_width, int panel_height) {
+  Video* v = _video_at(vid);
+  if (v->profile != VideoOpenProfile_Preview || v->codec_ctx == NULL) {
+    return;
+  }
+  int div = video_previewdiv(v, res, panel_width, panel_height);
+  if (div == v->out_div) {
+    return;
+  }
+  if (v->async) {
+    thread_mutex_lock(&v->codec_mtx);
+  }
+  int lowres = 0;
+  while (lowres < v->codec_ctx->codec->max_lowres && (2 << lowres) <= div) {
+    lowres++;
+  }
+  if (lowres != v->codec_ctx->lowres && video_opendecoder(v, lowres) != NULL) {
+    video_opendecoder(v, 0);
+  }
+  v->out_div = div;
+  video_allocoutput(v, FFMAX(v->codec_params->width / div, 2), FFMAX(v->codec_params->height / div, 2));
+  v->shown_secs = -1.0;
+  // the decoder may have been reopened, so start again from the current position
+  v->needs_seek = true;
+  v->run_key_pts = AV_NOPTS_VALUE;
+  if (v->async) {
+    thread_mutex_lock(&v->decode_mtx);
+    v->ring_num = 0;
+    thread_mutex_unlock(&v->decode_mtx);
+    thread_mutex_unlock(&v->codec_mtx);
+  }
+}
+
+void video_setshuttle(VideoId vid, double speed) {
+  _video_at(vid)->shuttle = speed;
+}
+
+double video_frame_secs(VideoId vid) {
+  return _video_at(vid)->frame_secs;
+}
+
 double video_total_secs(VideoId vid) {
   return _video_at(vid)->total_secs;
 }
 double video_pos_secs(VideoId vid) {
   return _video_at(vid)->pos_secs;
 }
+VideoStats video_stats(VideoId vid) {
+  Video* v = _video_at(vid);
+  VideoStats stats;
+  if (v->async) {
+    thread_mutex_lock(&v->decode_mtx);
+    stats = v->stats;
+    thread_mutex_unlock(&v->decode_mtx);
+  } else {
+    stats = v->stats;
+  }
+  stats.packet_allocs = thread_atomic_int_load(&v->vid_queue.allocs) + thread_atomic_int_load(&v->aud_queue.allocs);
+  return stats;
+}
 int video_width(VideoId vid) {
   return _video_at(vid)->codec_params->width;
 }
@@ -491,63 +1860,201 @@ int video_height(VideoId vid) {
   return _video_at(vid)->codec_params->height;
 }
 sg_image video_image(VideoId vid) {
-  return _video_at(vid)->img;
+  Video* v = _video_at(vid);
+  v->img_handedout = true;
+  return v->shown_planes.layout != VideoLayout_Rgba ? v->rgb_img[v->img_shown] : v->img[v->img_shown];
 }
 const char* video_filename(VideoId vid) {
-  const char* path = _video_at(vid)->filepath;
+  const char* path = _video_at(vid)->file->path;
   char* lastslash = strrchr(path, '/');
   return lastslash ? lastslash + 1 : path;
 }
 const char* video_filepath(VideoId vid) {
-  return _video_at(vid)->filepath;
+  return _video_at(vid)->file->path;
 }
 
-struct sg_image video_make_thumbnail(VideoId vid, double pos_secs, int* width, int* height) {
-  Video* v = _video_at(vid);
-  int64_t timestamp = (int64_t)((double)pos_secs * av_q2d(av_inv_q(v->fmt_ctx->streams[v->vidstreamidx]->time_base)));
-  av_seek_frame(v->fmt_ctx, v->vidstreamidx, timestamp, AVSEEK_FLAG_BACKWARD);
-  v->pos_secs = pos_secs;
-  v->next_swap_secs = 0.0f;
+struct Waveform* video_waveform(VideoId vid) {
+  return _video_at(vid)->file->waveform;
+}
+
+// decodes the keyframe at or before timestamp, skipping every other frame
+static bool video_decodethumbnailframe(AVFormatContext* fmt_ctx, AVCodecContext* codec_ctx, int streamidx,
+                                       int64_t timestamp, AVFrame* frame) {
+  enum AVDiscard skip_frame = codec_ctx->skip_frame, skip_loop_filter = codec_ctx->skip_loop_filter;
+  codec_ctx->skip_frame = AVDISCARD_NONKEY;
+  codec_ctx->skip_loop_filter = AVDISCARD_ALL;
+  av_seek_frame(fmt_ctx, streamidx, timestamp, AVSEEK_FLAG_BACKWARD);
+  bool gotframe = false;
   AVPacket packet;
-  while (av_read_frame(v->fmt_ctx, &packet) >= 0) {
-    if (avcodec_send_packet(v->codec_ctx, &packet) < 0) {
+  while (!gotframe && av_read_frame(fmt_ctx, &packet) >= 0) {
+    if (packet.stream_index != streamidx || avcodec_send_packet(codec_ctx, &packet) < 0) {
       av_packet_unref(&packet);
       continue;
     }
-    if (avcodec_receive_frame(v->codec_ctx, v->frame_raw) >= 0) {
-      int tgtheight = v->codec_params->height * *width / v->codec_params->width;
-      int tgtwidth = v->codec_params->width * *height / v->codec_params->height;
-      if (tgtheight < *height) {
-        *height = tgtheight;
-      } else {
-        *width = tgtwidth;
-      }
-      struct SwsContext* sws_ctx =
-          sws_getContext(v->codec_params->width, v->codec_params->height, v->codec_params->format, *width, *height,
-                         AV_PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
-      int imgbuflen = av_image_get_buffer_size(AV_PIX_FMT_RGBA, *width, *height, 1);
-      void* imgbuf = av_malloc(imgbuflen);
-      AVFrame* frame_rgb = av_frame_alloc();
-      av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, imgbuf, AV_PIX_FMT_RGBA, *width, *height, 1);
-      sws_scale(sws_ctx, v->frame_raw->data, v->frame_raw->linesize, 0, v->codec_params->height, frame_rgb->data,
-                frame_rgb->linesize);
-      sg_image img = sg_make_image(&(sg_image_desc){
-          .width = *width,
-          .height = *height,
-          .pixel_format = SG_PIXELFORMAT_RGBA8,
-          .min_filter = SG_FILTER_LINEAR,
-          .mag_filter = SG_FILTER_LINEAR,
-          .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
-          .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
-          .data.subimage[0][0] = {.ptr = imgbuf, .size = imgbuflen},
-      });
-      av_free(imgbuf);
-      sws_freeContext(sws_ctx);
-      av_frame_free(&frame_rgb);
-      av_packet_unref(&packet);
-      return img;
-    }
+    bool key = packet.flags & AV_PKT_FLAG_KEY;
     av_packet_unref(&packet);
+    gotframe = avcodec_receive_frame(codec_ctx, frame) >= 0;
+    if (!gotframe && key) {
+      // drain rather than reading up to the next keyframe while the decoder holds on to this one for reordering
+      avcodec_send_packet(codec_ctx, NULL);
+      gotframe = avcodec_receive_frame(codec_ctx, frame) >= 0;
+      avcodec_flush_buffers(codec_ctx);
+    }
   }
-  return (sg_image){0};
+  codec_ctx->skip_frame = skip_frame;
+  codec_ctx->skip_loop_filter = skip_loop_filter;
+  return gotframe;
+}
+
+// scalers are kept between thumbnails, sws_getCachedContext only rebuilds them when the sizes or formats change
+#define VIDEO_MAX_THUMBNAIL_SCALERS (16)
+typedef struct {
+  thread_mutex_t mtx;
+  struct SwsContext* scalers[VIDEO_MAX_THUMBNAIL_SCALERS];
+  int num;
+} ThumbnailScalers;
+static ThumbnailScalers _thumbnailscalers;
+
+static void videopool_initscalers(void) {
+  thread_mutex_init(&_thumbnailscalers.mtx);
+}
+
+static struct SwsContext* video_takescaler(void) {
+  ThumbnailScalers* s = &_thumbnailscalers;
+  thread_mutex_lock(&s->mtx);
+  struct SwsContext* sws_ctx = s->num > 0 ? s->scalers[--s->num] : NULL;
+  thread_mutex_unlock(&s->mtx);
+  return sws_ctx;
+}
+
+static void video_returnscaler(struct SwsContext* sws_ctx) {
+  ThumbnailScalers* s = &_thumbnailscalers;
+  thread_mutex_lock(&s->mtx);
+  if (s->num < VIDEO_MAX_THUMBNAIL_SCALERS) {
+    s->scalers[s->num++] = sws_ctx;
+    sws_ctx = NULL;
+  }
+  thread_mutex_unlock(&s->mtx);
+  sws_freeContext(sws_ctx);
+}
+
+// scales a frame to fit inside width x height, returns the RGBA pixels which must be freed with av_free
+static uint8_t* video_scalethumbnail(const AVFrame* frame, int* width, int* height) {
+  int tgtheight = frame->height * *width / frame->width;
+  int tgtwidth = frame->width * *height / frame->height;
+  if (tgtheight < *height) {
+    *height = tgtheight;
+  } else {
+    *width = tgtwidth;
+  }
+  // area averaging doesn't alias when shrinking 4K down to a few hundred pixels
+  struct SwsContext* sws_ctx = sws_getCachedContext(video_takescaler(), frame->width, frame->height, frame->format,
+                                                    *width, *height, AV_PIX_FMT_RGBA, SWS_AREA, NULL, NULL, NULL);
+  int imgbuflen = av_image_get_buffer_size(AV_PIX_FMT_RGBA, *width, *height, 1);
+  uint8_t* imgbuf = av_malloc(imgbuflen);
+  uint8_t* data[4];
+  int linesize[4];
+  av_image_fill_arrays(data, linesize, imgbuf, AV_PIX_FMT_RGBA, *width, *height, 1);
+  sws_scale(sws_ctx, (const uint8_t* const*)frame->data, frame->linesize, 0, frame->height, data, linesize);
+  video_returnscaler(sws_ctx);
+  return imgbuf;
+}
+
+// opens a decoder for a thumbnail, decoding at the smallest resolution the codec supports that still covers the
+// bounding box
+static AVCodecContext* video_openthumbnaildecoder(AVStream* stream, int box_width, int box_height) {
+  const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+  if (codec == NULL) {
+    return NULL;
+  }
+  AVCodecContext* codec_ctx = avcodec_alloc_context3(codec);
+  if (codec_ctx == NULL || avcodec_parameters_to_context(codec_ctx, stream->codecpar) != 0) {
+    avcodec_free_context(&codec_ctx);
+    return NULL;
+  }
+  codec_ctx->thread_count = video_thumbnail_profile.thread_count;
+  int lowres = 0;
+  while (lowres < codec->max_lowres && (stream->codecpar->width >> (lowres + 1)) >= box_width &&
+         (stream->codecpar->height >> (lowres + 1)) >= box_height) {
+    lowres++;
+  }
+  codec_ctx->lowres = lowres;
+  if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+    avcodec_free_context(&codec_ctx);
+    return NULL;
+  }
+  return codec_ctx;
+}
+
+// cover art is a single still image, there's nothing to seek or decode ahead for
+static bool video_decodeattachedpic(AVFormatContext* fmt_ctx, int box_width, int box_height, AVFrame* frame) {
+  for (int i = 0; i < (int)fmt_ctx->nb_streams; i++) {
+    AVStream* stream = fmt_ctx->streams[i];
+    if (!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+      continue;
+    }
+    AVCodecContext* codec_ctx = video_openthumbnaildecoder(stream, box_width, box_height);
+    if (codec_ctx == NULL) {
+      continue;
+    }
+    bool gotframe = avcodec_send_packet(codec_ctx, &stream->attached_pic) >= 0 &&
+                    avcodec_send_packet(codec_ctx, NULL) >= 0 && avcodec_receive_frame(codec_ctx, frame) >= 0;
+    avcodec_free_context(&codec_ctx);
+    if (gotframe) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* video_decode_thumbnail(const char* path, double pos_secs, VideoThumbnail* thumb) {
+  AVFormatContext* fmt_ctx = NULL;
+  AVCodecContext* codec_ctx = NULL;
+  AVFrame* frame = NULL;
+  const char* err = video_openformat(path, &video_thumbnail_profile, NULL, &fmt_ctx);
+  if (err) {
+    goto cleanup;
+  }
+  int streamidx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (streamidx < 0) {
+    err = "Failed to find video stream";
+    goto cleanup;
+  }
+  AVStream* stream = fmt_ctx->streams[streamidx];
+  thumb->total_secs = (double)fmt_ctx->duration * av_q2d(AV_TIME_BASE_Q);
+  thumb->video_width = stream->codecpar->width;
+  thumb->video_height = stream->codecpar->height;
+  frame = av_frame_alloc();
+  // poster thumbnails use the embedded cover if there is one
+  if (pos_secs > 0.0 || !video_decodeattachedpic(fmt_ctx, thumb->width, thumb->height, frame)) {
+    for (int i = 0; i < (int)fmt_ctx->nb_streams; i++) {
+      fmt_ctx->streams[i]->discard = i == streamidx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    codec_ctx = video_openthumbnaildecoder(stream, thumb->width, thumb->height);
+    if (codec_ctx == NULL) {
+      err = "Failed to open codec";
+      goto cleanup;
+    }
+    if (!video_decodethumbnailframe(fmt_ctx, codec_ctx, streamidx, video_streamsecstopts(stream, pos_secs), frame)) {
+      err = "Failed to decode a frame";
+      goto cleanup;
+    }
+  }
+  thumb->pixels = video_scalethumbnail(frame, &thumb->width, &thumb->height);
+cleanup:
+  if (frame) {
+    av_frame_free(&frame);
+  }
+  if (codec_ctx) {
+    avcodec_free_context(&codec_ctx);
+  }
+  if (fmt_ctx) {
+    avformat_close_input(&fmt_ctx);
+  }
+  return err;
+}
+
+void video_free_thumbnail(VideoThumbnail* thumb) {
+  av_free(thumb->pixels);
+  thumb->pixels = NULL;
 }
@@ -9,17 +9,51 @@ typedef struct {
 #define VIDEO_POOL_SIZE (1024)
 
 void videopool_init();
+// closes every video that's still open and releases the frame cache, the audio thread must be stopped first
+void videopool_shutdown(void);
 
 typedef union thread_mutex_t thread_mutex_t;
 
+// jumps forward of up to this many seconds are decoded through instead of seeking
+#define VIDEO_DEFAULT_SEEK_WINDOW_SECS (2.0)
+
+// what the video is opened for, decides how much gets probed and allocated
+typedef enum {
+  VideoOpenProfile_Preview = 0, // decoder + streaming texture for playback in the editor
+  VideoOpenProfile_Export,      // thorough probe + every decoder thread, frames stay on the CPU
+} VideoOpenProfile;
+
+// how far the demuxer reads ahead into a packet queue. reading starts once the queue has less than low_bytes or
+// low_secs buffered, and stops once it reaches either high_bytes or high_secs
+typedef struct {
+  int low_bytes, high_bytes;
+  double low_secs, high_secs;
+} VideoQueueLimits;
+
 typedef struct VideoOpenParams {
+  VideoOpenProfile profile;
   bool disable_audio;
+  double seek_window_secs; // 0 uses VIDEO_DEFAULT_SEEK_WINDOW_SECS
+  bool async_decode;       // decode + convert on a background thread, video_nextframe only uploads. not for probe/thumbnail
+  VideoQueueLimits video_queue, audio_queue; // zeroed limits use the defaults
+  int pcm_cache_rate, pcm_cache_channels;     // decode the audio once into a cache file in this format, 0 doesn't
 } VideoOpenParams;
 typedef struct {
   VideoId vid;
   const char* err;
 } VideoOpenRes;
 VideoOpenRes video_open(const char* path, const VideoOpenParams* p);
+// opens another video on the same file with the same params. it decodes independently of vid but shares its keyframe
+// index, waveform, pcm cache and cached frames
+VideoOpenRes video_opencursor(VideoId vid);
+// the same as video_opencursor with the demuxer + decoders opened on a background thread, which keeps a slow probe
+// off the main thread. poll video_opencursor_ready until it returns true, which frees 'op' and sets *res. a cursor
+// that isn't wanted any more is dropped with video_opencursor_cancel, which cuts the probe short and waits for the
+// thread
+typedef struct VideoCursorOpen VideoCursorOpen;
+VideoCursorOpen* video_opencursor_async(VideoId vid);
+bool video_opencursor_ready(VideoCursorOpen* op, VideoOpenRes* res);
+void video_opencursor_cancel(VideoCursorOpen* op);
 void video_close(VideoId vid);
 
 void video_gc_clearmarks(void);
@@ -28,13 +62,62 @@ void video_gc_sweep(void);
 
 void video_nextframe(VideoId vid, double pos_secs, thread_mutex_t* aud_thread_mtx); // locks aud_thread_mtx
 void video_getaudio_underlock(VideoId vid, float* frames, int num_frames, int num_channels, int sample_rate);          // assumes aud_thread_mtx is locked
+int video_audiogen_underlock(VideoId vid); // changes whenever a seek or skip throws away the queued audio
+// positions an async video at pos_secs ahead of time: the decode thread seeks there and decodes frames until the ring is
+// full, so the first video_nextframe from there on shows them straight away. speed is the shuttle speed it'll be
+// played at. does nothing if it's already there
+void video_prefetch(VideoId vid, double pos_secs, double speed, thread_mutex_t* aud_thread_mtx);
+typedef enum {
+  VideoPreviewRes_Fit = 0, // the smallest power of two fraction of the full size that still covers the panel
+  VideoPreviewRes_Full,
+  VideoPreviewRes_Half,
+  VideoPreviewRes_Quarter,
+} VideoPreviewRes;
+// sets the size frames are decoded + converted at for a preview panel of panel_width x panel_height pixels, only
+// preview videos are affected, export always decodes at full resolution
+void video_setpreviewres(VideoId vid, VideoPreviewRes res, int panel_width, int panel_height);
+// shuttle speeds from -VIDEO_SHUTTLE_MAX_SPEED to VIDEO_SHUTTLE_MAX_SPEED. from VIDEO_SHUTTLE_KEYONLY_SPEED up only
+// keyframes are decoded
+#define VIDEO_SHUTTLE_MAX_SPEED (32.0)
+#define VIDEO_SHUTTLE_KEYONLY_SPEED (8.0)
+// the speed the playhead is moving at, negative decodes backwards through the GOPs instead of seeking for every frame.
+// 0 while paused + scrubbing. only async videos play smoothly in reverse
+void video_setshuttle(VideoId vid, double speed);
+double video_frame_secs(VideoId vid);
 double video_total_secs(VideoId vid);
 double video_pos_secs(VideoId vid);
+
+typedef struct {
+  int seeks;
+  int frames_shown;          // new frames uploaded for drawing
+  int forward_decodes;       // jumps forward that were decoded through instead of seeking
+  int upload_stalls_avoided; // uploads that went to a spare texture instead of the one being drawn
+  int packet_allocs;         // AVPackets allocated for the queues, stays flat once playback has warmed up
+  int frames_late;           // shown after the next frame was already due, because it hadn't been decoded yet
+  int frames_dropped;        // decoded in time but replaced by a newer frame before they were shown
+  int frames_skipped;        // never decoded, the decoder was discarding frames to catch up with the playhead
+  // async videos time every jump of the playhead until its image is uploaded for drawing: the first image shown
+  // (a cached frame or keyframe standing in) and the exact frame, for the latest jump and the worst one so far
+  int scrubs;
+  double scrub_preview_secs, scrub_latency_secs, scrub_latency_max_secs;
+} VideoStats;
+VideoStats video_stats(VideoId vid);
 int video_width(VideoId vid);
 int video_height(VideoId vid);
+// the texture holding the newest complete frame, it changes as frames rotate through the texture ring
 struct sg_image video_image(VideoId vid);
 const char* video_filename(VideoId vid);
 const char* video_filepath(VideoId vid);
+// the audio peaks drawn on the clips, NULL without an audio stream
+struct Waveform* video_waveform(VideoId vid);
 
-// makes a new image thumbnail. the caller takes ownership of the sg_image if successful.
-struct sg_image video_make_thumbnail(VideoId vid, double pos_secs, int* width, int* height);
+typedef struct VideoThumbnail {
+  uint8_t* pixels; // RGBA
+  int width, height;
+  int video_width, video_height;
+  double total_secs;
+} VideoThumbnail;
+// decodes a thumbnail using its own short-lived demuxer + decoder so it's safe to call from any thread and never
+// disturbs an open video. width + height are the bounding box, returns an error or NULL on success
+const char* video_decode_thumbnail(const char* path, double pos_secs, VideoThumbnail* thumb);
+void video_free_thumbnail(VideoThumbnail* thumb);
@@ -3,6 +3,8 @@
 #include <dirent.h>
 #include "json.h"
 #include <assert.h>
+#include <math.h>
+#include <stdlib.h>
 #include "debuglog.h"
 
 void videoclips_push(VideoClips* l, VideoClip c) {
@@ -19,11 +21,93 @@ void videoclips_free(VideoClips* l) {
   for (int i = 0; i < l->num; i++) {
     VideoClip* clip = &l->clips[i];
     sg_destroy_image(clip->thumbnail);
+    thumbnails_cancel(clip->thumbnail_req);
   }
   free(l->clips);
   *l = (VideoClips){0};
 }
 
+void videoclips_runextent(const VideoClips* l, const VideoClip* clip, double* start, double* end) {
+  const double eps = 1e-6;
+  *start = clip->pos;
+  *end = clip->pos + (clip->clipend - clip->clipstart);
+  double srcstart = clip->clipstart, srcend = clip->clipend;
+  for (bool grew = true; grew;) {
+    grew = false;
+    for (int i = 0; i < l->num; i++) {
+      const VideoClip* o = &l->clips[i];
+      if (o->vid.id != clip->vid.id || o->track != clip->track) {
+        continue;
+      }
+      double oend = o->pos + (o->clipend - o->clipstart);
+      if (fabs(oend - *start) < eps && fabs(o->clipend - srcstart) < eps) {
+        *start = o->pos;
+        srcstart = o->clipstart;
+        grew = true;
+      } else if (fabs(o->pos - *end) < eps && fabs(o->clipstart - srcend) < eps) {
+        *end = oend;
+        srcend = o->clipend;
+        grew = true;
+      }
+    }
+  }
+}
+
+// the run each clip belongs to is identified by the position it starts at on the clip's track
+static double* videoclips_runstarts(const VideoClips* l) {
+  double* runstarts = (double*)malloc(sizeof(double) * (size_t)(l->num > 0 ? l->num : 1));
+  assert(runstarts);
+  for (int i = 0; i < l->num; i++) {
+    double runend;
+    videoclips_runextent(l, &l->clips[i], &runstarts[i], &runend);
+  }
+  return runstarts;
+}
+
+static bool videoclips_inrun(const VideoClips* l, const double* runstarts, int i, VideoId vid, int track,
+                             double runstart) {
+  return l->clips[i].vid.id == vid.id && l->clips[i].track == track && fabs(runstarts[i] - runstart) < 1e-6;
+}
+
+int videoclips_sharedruns(const VideoClips* l, int* runs, int max) {
+  double* runstarts = videoclips_runstarts(l);
+  int num = 0;
+  for (int i = 0; i < l->num && num < max; i++) {
+    bool shared = false, seen = false;
+    for (int j = 0; j < i && !seen; j++) {
+      shared |= l->clips[j].vid.id == l->clips[i].vid.id;
+      seen = videoclips_inrun(l, runstarts, j, l->clips[i].vid, l->clips[i].track, runstarts[i]);
+    }
+    if (shared && !seen) {
+      runs[num++] = i;
+    }
+  }
+  free(runstarts);
+  return num;
+}
+
+int videoclips_moverun(VideoClips* l, VideoId vid, int track, double runstart, VideoId newvid) {
+  double* runstarts = videoclips_runstarts(l);
+  int moved = 0;
+  bool shared = false;
+  for (int i = 0; i < l->num; i++) {
+    bool inrun = videoclips_inrun(l, runstarts, i, vid, track, runstart);
+    moved += inrun;
+    shared |= !inrun && l->clips[i].vid.id == vid.id;
+  }
+  if (moved > 0 && shared) {
+    for (int i = 0; i < l->num; i++) {
+      if (videoclips_inrun(l, runstarts, i, vid, track, runstart)) {
+        l->clips[i].vid = newvid;
+      }
+    }
+  } else {
+    moved = 0;
+  }
+  free(runstarts);
+  return moved;
+}
+
 const char* videoclips_save(const char* path, const VideoClips* clips) {
   FILE* f = fopen(path, "wb");
   if (f == NULL) {
@@ -43,8 +127,9 @@ const char* videoclips_save(const char* path, const VideoClips* clips) {
       video_path++;
     }
     escaped_path[escaped_path_len] = '\0';
-    fprintf(f, "{\"pos\":%f,\"clipstart\":%f,\"clipend\":%f,\"track\":%d,\"path\":\"%s\"}%s\r\n", clip->pos,
-            clip->clipstart, clip->clipend, clip->track, escaped_path, i + 1 < clips->num ? "," : "");
+    fprintf(f, "{\"pos\":%f,\"clipstart\":%f,\"clipend\":%f,\"track\":%d,\"gain_db\":%f,\"path\":\"%s\"}%s\r\n",
+            clip->pos, clip->clipstart, clip->clipend, clip->track, clip->gain_db, escaped_path,
+            i + 1 < clips->num ? "," : "");
   }
   fprintf(f, "]}\r\n");
   fclose(f);
@@ -60,6 +145,43 @@ static double json_value_as_double(struct json_value_s* el) {
   }
 }
 
+// opens a video for each run of the parsed clips, whose vids are still placeholders for their paths. the slices of a
+// run share one, the same as videoclips_sharedruns would leave them after an edit. every run still gets a full
+// video_open, a clip on the timeline needs a live demuxer + decoder, only its thumbnail comes from the media cache
+static const char* videoclips_openruns(const VideoClips* parsed, const char** paths, VideoClips* clips,
+                                       const VideoOpenParams* p) {
+  double* runstarts = videoclips_runstarts(parsed);
+  VideoId* vids = (VideoId*)malloc(sizeof(VideoId) * (size_t)(parsed->num > 0 ? parsed->num : 1));
+  assert(vids);
+  const char* err = NULL;
+  for (int i = 0; i < parsed->num; i++) {
+    VideoClip clip = parsed->clips[i];
+    int samerun = 0;
+    while (samerun < i && !videoclips_inrun(parsed, runstarts, samerun, clip.vid, clip.track, runstarts[i])) {
+      samerun++;
+    }
+    if (samerun < i) {
+      vids[i] = vids[samerun];
+    } else {
+      VideoOpenRes res = video_open(paths[i], p);
+      if (res.err) {
+        DebugLog("failed to open %s: %s\n", paths[i], res.err);
+        err = "failed to open video file";
+        break;
+      }
+      vids[i] = res.vid;
+    }
+    clip.vid = vids[i];
+    clip.thumbnail_req = thumbnails_request(paths[i], clip.clipstart, 100, 100, 0);
+    clip.thumbnail_width = 100;
+    clip.thumbnail_height = 100;
+    videoclips_push(clips, clip);
+  }
+  free(vids);
+  free(runstarts);
+  return err;
+}
+
 const char* videoclips_load(const char* path, VideoClips* clips, const VideoOpenParams* p) {
   FILE* f = fopen(path, "rb");
   if (f == NULL) {
@@ -77,6 +199,8 @@ const char* videoclips_load(const char* path, VideoClips* clips, const VideoOpen
   }
 
   struct json_value_s* root = json_parse(buf, len);
+  VideoClips parsed = {0};
+  const char** paths = NULL;
   if (root) {
     struct json_object_s* file = json_value_as_object(root);
     if (file) {
@@ -90,6 +214,7 @@ const char* videoclips_load(const char* path, VideoClips* clips, const VideoOpen
                 continue;
               }
               VideoClip parsedclip = (VideoClip){0};
+              const char* parsedpath = NULL;
               for (struct json_object_element_s* clipobjentry = clip->start; clipobjentry;
                    clipobjentry = clipobjentry->next) {
                 if (strcmp(clipobjentry->name->string, "pos") == 0) {
@@ -100,24 +225,23 @@ const char* videoclips_load(const char* path, VideoClips* clips, const VideoOpen
                   parsedclip.clipend = json_value_as_double(clipobjentry->value);
                 } else if (strcmp(clipobjentry->name->string, "track") == 0) {
                   parsedclip.track = (int)json_value_as_double(clipobjentry->value);
+                } else if (strcmp(clipobjentry->name->string, "gain_db") == 0) {
+                  parsedclip.gain_db = (float)json_value_as_double(clipobjentry->value);
                 } else if (strcmp(clipobjentry->name->string, "path") == 0) {
-                  const char* video_path = json_value_as_string(clipobjentry->value)->string;
-                  VideoOpenRes res = video_open(video_path, p);
-                  if (res.err) {
-                    DebugLog("failed to open %s: %s\n", path, res.err);
-                    free(root);
-                    return "failed to open video file";
-                  } else {
-                    parsedclip.vid = res.vid;
-                  }
+                  parsedpath = json_value_as_string(clipobjentry->value)->string;
                 }
               }
-              if (parsedclip.vid.id) {
-                int width = 100, height = 100;
-                parsedclip.thumbnail = video_make_thumbnail(parsedclip.vid, parsedclip.clipstart, &width, &height);
-                parsedclip.thumbnail_width = width;
-                parsedclip.thumbnail_height = height;
-                videoclips_push(clips, parsedclip);
+              if (parsedpath) {
+                // until the videos are opened each path stands in for its video
+                paths = (const char**)realloc(paths, sizeof(const char*) * (size_t)(parsed.num + 1));
+                assert(paths);
+                paths[parsed.num] = parsedpath;
+                int first = 0;
+                while (strcmp(paths[first], parsedpath) != 0) {
+                  first++;
+                }
+                parsedclip.vid.id = (uint32_t)first + 1;
+                videoclips_push(&parsed, parsedclip);
               }
             }
           }
@@ -126,6 +250,9 @@ const char* videoclips_load(const char* path, VideoClips* clips, const VideoOpen
       }
     }
   }
+  const char* err = videoclips_openruns(&parsed, paths, clips, p);
+  free(parsed.clips);
+  free(paths);
   free(root);
-  return NULL;
+  return err;
 }
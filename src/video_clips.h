@@ -1,11 +1,14 @@
 #pragma once
 #include <sokol/sokol_gfx.h>
 #include "video.h"
+#include "thumbnails.h"
 
 typedef struct {
   double pos, clipstart, clipend;
   int track;
+  float gain_db; // audio gain, 0 is unchanged
   sg_image thumbnail;
+  ThumbnailId thumbnail_req; // set until the thumbnail has been generated
   int thumbnail_width, thumbnail_height;
   VideoId vid;
 } VideoClip;
@@ -16,6 +19,17 @@ typedef struct {
 } VideoClips;
 
 void videoclips_push(VideoClips* l, VideoClip c);
+// the part of the timeline covered by clip and the slices next to it on its track that carry on the same video without
+// a gap, which play through as one clip
+void videoclips_runextent(const VideoClips* l, const VideoClip* clip, double* start, double* end);
+// clips that use one video at different places get a decode cursor each, so they don't seek a shared decoder back and
+// forth. only the slices of a run keep sharing one, playback carries on from one into the next. this writes the index
+// of the first clip of every run that shares its video with an earlier run to 'runs', up to 'max' of them, and
+// returns how many there are
+int videoclips_sharedruns(const VideoClips* l, int* runs, int max);
+// moves every clip of the run starting at runstart on the track from vid over to newvid. returns how many clips moved,
+// 0 when the run has gone or no other run shares vid any more
+int videoclips_moverun(VideoClips* l, VideoId vid, int track, double runstart, VideoId newvid);
 const char* videoclips_save(const char* path, const VideoClips* clips);
 const char* videoclips_load(const char* path, VideoClips* clips, const struct VideoOpenParams* p);
 void videoclips_free(VideoClips* l);
@@ -0,0 +1,247 @@
+#include "video_index.h"
+#include "file_cache.h"
+#include <libavformat/avformat.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define VIDEOINDEX_MAGIC (0x58495346) // 'FSIX'
+#define VIDEOINDEX_VERSION (2) // 1 could hold packets without timestamps
+
+typedef struct {
+  int64_t pts;
+  int idx;
+} VideoIndexPts;
+
+struct VideoIndex {
+  char path[1024], cachepath[1024];
+  int streamidx;
+  FileFingerprint fp;
+
+  thread_ptr_t thread;
+  thread_atomic_int_t ready, cancel;
+
+  VideoIndexEntry* entries; // decode order
+  int num, cap;
+  VideoIndexPts* by_pts; // presentation order
+  VideoIndexPts* keys;   // the keyframes in presentation order
+  int num_keys;
+};
+
+typedef struct {
+  uint32_t magic, version;
+  int64_t size, mtime;
+  int32_t streamidx, num;
+  char path[1024];
+} VideoIndexHeader;
+
+static void videoindex_push(VideoIndex* idx, VideoIndexEntry e) {
+  if (idx->num + 1 >= idx->cap) {
+    idx->cap = idx->cap ? idx->cap * 2 : 1024;
+    void* newblock = realloc(idx->entries, idx->cap * sizeof(VideoIndexEntry));
+    assert(newblock);
+    idx->entries = (VideoIndexEntry*)newblock;
+  }
+  idx->entries[idx->num++] = e;
+}
+
+static int videoindex_cmppts(const void* a, const void* b) {
+  int64_t pa = ((const VideoIndexPts*)a)->pts, pb = ((const VideoIndexPts*)b)->pts;
+  return pa < pb ? -1 : pa > pb;
+}
+
+// builds the lookup tables once all the entries are known
+static void videoindex_finish(VideoIndex* idx) {
+  idx->by_pts = (VideoIndexPts*)malloc(sizeof(VideoIndexPts) * (idx->num + 1));
+  idx->keys = (VideoIndexPts*)malloc(sizeof(VideoIndexPts) * (idx->num + 1));
+  assert(idx->by_pts && idx->keys);
+  for (int i = 0; i < idx->num; i++) {
+    idx->by_pts[i] = (VideoIndexPts){.pts = idx->entries[i].pts, .idx = i};
+    if (idx->entries[i].key) {
+      idx->keys[idx->num_keys++] = idx->by_pts[i];
+    }
+  }
+  qsort(idx->by_pts, idx->num, sizeof(VideoIndexPts), videoindex_cmppts);
+  qsort(idx->keys, idx->num_keys, sizeof(VideoIndexPts), videoindex_cmppts);
+}
+
+static bool videoindex_load(VideoIndex* idx) {
+  FILE* f = fopen(idx->cachepath, "rb");
+  if (f == NULL) {
+    return false;
+  }
+  VideoIndexHeader h;
+  bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == VIDEOINDEX_MAGIC && h.version == VIDEOINDEX_VERSION &&
+            h.size == idx->fp.size && h.mtime == idx->fp.mtime && h.streamidx == idx->streamidx &&
+            strncmp(h.path, idx->path, sizeof(h.path)) == 0 && h.num >= 0;
+  if (ok) {
+    idx->entries = (VideoIndexEntry*)malloc(sizeof(VideoIndexEntry) * (h.num + 1));
+    assert(idx->entries);
+    idx->num = idx->cap = h.num;
+    ok = fread(idx->entries, sizeof(VideoIndexEntry), h.num, f) == (size_t)h.num;
+  }
+  fclose(f);
+  if (!ok) {
+    free(idx->entries);
+    idx->entries = NULL;
+    idx->num = idx->cap = 0;
+  }
+  return ok;
+}
+
+static void videoindex_save(VideoIndex* idx) {
+  FILE* f = fopen(idx->cachepath, "wb");
+  if (f == NULL) {
+    return;
+  }
+  VideoIndexHeader h = {.magic = VIDEOINDEX_MAGIC,
+                        .version = VIDEOINDEX_VERSION,
+                        .size = idx->fp.size,
+                        .mtime = idx->fp.mtime,
+                        .streamidx = idx->streamidx,
+                        .num = idx->num};
+  snprintf(h.path, sizeof(h.path), "%s", idx->path);
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(idx->entries, sizeof(VideoIndexEntry), idx->num, f);
+  fclose(f);
+}
+
+// demux-only pass over the file, nothing is decoded
+static bool videoindex_scan(VideoIndex* idx) {
+  AVFormatContext* fmt_ctx = NULL;
+  if (avformat_open_input(&fmt_ctx, idx->path, NULL, NULL) != 0) {
+    return false;
+  }
+  // containers with headers know their streams without probing packets
+  if ((int)fmt_ctx->nb_streams <= idx->streamidx && avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+    avformat_close_input(&fmt_ctx);
+    return false;
+  }
+  if ((int)fmt_ctx->nb_streams <= idx->streamidx) {
+    avformat_close_input(&fmt_ctx);
+    return false;
+  }
+  for (int i = 0; i < (int)fmt_ctx->nb_streams; i++) {
+    fmt_ctx->streams[i]->discard = i == idx->streamidx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+  AVPacket packet;
+  bool cancelled = false;
+  while (av_read_frame(fmt_ctx, &packet) >= 0) {
+    int64_t pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+    // a packet without any timestamp can't be placed in presentation order
+    if (packet.stream_index == idx->streamidx && pts != AV_NOPTS_VALUE) {
+      videoindex_push(idx, (VideoIndexEntry){.pts = pts,
+                                             .dts = packet.dts != AV_NOPTS_VALUE ? packet.dts : pts,
+                                             .pos = packet.pos,
+                                             .key = (packet.flags & AV_PKT_FLAG_KEY) != 0});
+    }
+    av_packet_unref(&packet);
+    if (thread_atomic_int_load(&idx->cancel)) {
+      cancelled = true;
+      break;
+    }
+  }
+  avformat_close_input(&fmt_ctx);
+  return !cancelled && idx->num > 0;
+}
+
+static int videoindex_thread(void* user_data) {
+  VideoIndex* idx = (VideoIndex*)user_data;
+  if (videoindex_load(idx)) {
+    videoindex_finish(idx);
+    thread_atomic_int_store(&idx->ready, 1);
+  } else if (videoindex_scan(idx)) {
+    videoindex_save(idx);
+    videoindex_finish(idx);
+    thread_atomic_int_store(&idx->ready, 1);
+  }
+  return 0;
+}
+
+VideoIndex* videoindex_open(const char* path, int streamidx) {
+  VideoIndex* idx = (VideoIndex*)calloc(1, sizeof(VideoIndex));
+  assert(idx);
+  snprintf(idx->path, sizeof(idx->path), "%s", path);
+  idx->streamidx = streamidx;
+  if (!filecache_fingerprint(path, &idx->fp) || !filecache_path(path, "fsidx", idx->cachepath, sizeof(idx->cachepath))) {
+    return idx; // never becomes ready, callers fall back to plain seeking
+  }
+  thread_atomic_int_store(&idx->ready, 0);
+  thread_atomic_int_store(&idx->cancel, 0);
+  idx->thread = thread_create(videoindex_thread, idx, "video index", THREAD_STACK_SIZE_DEFAULT);
+  return idx;
+}
+
+void videoindex_free(VideoIndex* idx) {
+  if (idx == NULL) {
+    return;
+  }
+  if (idx->thread) {
+    thread_atomic_int_store(&idx->cancel, 1);
+    thread_join(idx->thread);
+    thread_destroy(idx->thread);
+  }
+  free(idx->entries);
+  free(idx->by_pts);
+  free(idx->keys);
+  free(idx);
+}
+
+bool videoindex_ready(VideoIndex* idx) {
+  return idx && thread_atomic_int_load(&idx->ready);
+}
+
+// index into 'a' (sorted by pts) of the last entry with pts <= 'pts', the first one if they're all later
+static int videoindex_findpts(const VideoIndexPts* a, int num, int64_t pts) {
+  int lo = 0, hi = num - 1, res = 0;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (a[mid].pts <= pts) {
+      res = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return res;
+}
+
+// the latest keyframe shown at or before 'pts'. with open GOPs the keyframe just before a frame in decode order can be
+// shown after it, decoding from there would never produce the frame
+static const VideoIndexPts* videoindex_findkey(VideoIndex* idx, int64_t pts) {
+  return &idx->keys[videoindex_findpts(idx->keys, idx->num_keys, pts)];
+}
+
+bool videoindex_keyframe(VideoIndex* idx, int64_t pts, VideoIndexEntry* key) {
+  if (!videoindex_ready(idx) || idx->num_keys == 0) {
+    return false;
+  }
+  *key = idx->entries[videoindex_findkey(idx, pts)->idx];
+  return true;
+}
+
+bool videoindex_framepts(VideoIndex* idx, int64_t pts, int64_t* frame_pts) {
+  if (!videoindex_ready(idx)) {
+    return false;
+  }
+  *frame_pts = idx->by_pts[videoindex_findpts(idx->by_pts, idx->num, pts)].pts;
+  return true;
+}
+
+int videoindex_decodecost(VideoIndex* idx, int64_t from_pts, int64_t to_pts) {
+  if (!videoindex_ready(idx)) {
+    return -1;
+  }
+  int from = idx->by_pts[videoindex_findpts(idx->by_pts, idx->num, from_pts)].idx;
+  int to = idx->by_pts[videoindex_findpts(idx->by_pts, idx->num, to_pts)].idx;
+  return to >= from ? to - from : -1;
+}
+
+int videoindex_seekcost(VideoIndex* idx, int64_t pts) {
+  if (!videoindex_ready(idx) || idx->num_keys == 0) {
+    return -1;
+  }
+  int entryidx = idx->by_pts[videoindex_findpts(idx->by_pts, idx->num, pts)].idx;
+  int keyidx = videoindex_findkey(idx, pts)->idx;
+  return entryidx >= keyidx ? entryidx - keyidx + 1 : -1; // frames shown before the first keyframe
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// one entry per video packet, in decode order. timestamps are in the stream time base
+typedef struct {
+  int64_t pts, dts, pos;
+  int32_t key;
+} VideoIndexEntry;
+
+typedef struct VideoIndex VideoIndex;
+
+// loads the index for the video stream 'streamidx' from the cache, or builds it on a background thread with a
+// demux-only pass over the file
+VideoIndex* videoindex_open(const char* path, int streamidx);
+void videoindex_free(VideoIndex* idx);
+bool videoindex_ready(VideoIndex* idx);
+
+// all functions below return false/-1 until the index is ready
+// finds the keyframe to seek to so the frame at 'pts' can be decoded: the latest one shown at or before it
+bool videoindex_keyframe(VideoIndex* idx, int64_t pts, VideoIndexEntry* key);
+// the pts of the frame that is displayed at 'pts'
+bool videoindex_framepts(VideoIndex* idx, int64_t pts, int64_t* frame_pts);
+// the number of packets that have to be decoded to get from the frame at 'from_pts' to the frame at 'to_pts',
+// -1 if 'to_pts' is behind 'from_pts'
+int videoindex_decodecost(VideoIndex* idx, int64_t from_pts, int64_t to_pts);
+// the number of packets that have to be decoded after seeking to reach the frame at 'pts'
+int videoindex_seekcost(VideoIndex* idx, int64_t pts);
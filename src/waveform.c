@@ -0,0 +1,256 @@
+#include "waveform.h"
+#include "file_cache.h"
+#include "audio_convert.h"
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define WAVEFORM_MAGIC (0x46575346) // 'FSWF'
+#define WAVEFORM_VERSION (2)
+
+typedef struct {
+  uint32_t magic, version;
+  int64_t size, mtime;
+  int32_t streamidx, sample_rate, num_levels;
+  int32_t offsets[WAVEFORM_MAX_LEVELS], nums[WAVEFORM_MAX_LEVELS]; // in peaks from the start of the peak data
+  char path[1024];
+} WaveformHeader;
+
+struct Waveform {
+  char path[1024], cachepath[1024];
+  int streamidx;
+  FileFingerprint fp;
+
+  thread_ptr_t thread;
+  thread_atomic_int_t ready, cancel;
+
+  // once ready, the peaks either point into the mapped cache file or at the buffer built by the scan
+  WaveformHeader header;
+  const WaveformPeak* peaks;
+  FileMap map;
+  WaveformPeak* built;
+  int num_built, cap_built;
+};
+
+static void waveform_push(Waveform* wf, WaveformPeak p) {
+  if (wf->num_built + 1 >= wf->cap_built) {
+    wf->cap_built = wf->cap_built ? wf->cap_built * 2 : 4096;
+    void* newblock = realloc(wf->built, wf->cap_built * sizeof(WaveformPeak));
+    assert(newblock);
+    wf->built = (WaveformPeak*)newblock;
+  }
+  wf->built[wf->num_built++] = p;
+}
+
+static bool waveform_load(Waveform* wf) {
+  if (!filecache_map(wf->cachepath, 0, &wf->map)) {
+    return false;
+  }
+  const WaveformHeader* h = (const WaveformHeader*)wf->map.data;
+  bool ok = wf->map.size >= sizeof(WaveformHeader) && h->magic == WAVEFORM_MAGIC && h->version == WAVEFORM_VERSION &&
+            h->size == wf->fp.size && h->mtime == wf->fp.mtime && h->streamidx == wf->streamidx &&
+            strncmp(h->path, wf->path, sizeof(h->path)) == 0 && h->num_levels > 0 &&
+            h->num_levels <= WAVEFORM_MAX_LEVELS;
+  size_t num_peaks = ok ? (wf->map.size - sizeof(WaveformHeader)) / sizeof(WaveformPeak) : 0;
+  for (int i = 0; ok && i < h->num_levels; i++) {
+    ok = h->offsets[i] >= 0 && h->nums[i] > 0 && (size_t)h->offsets[i] + h->nums[i] <= num_peaks;
+  }
+  if (!ok) {
+    filecache_unmap(&wf->map);
+    return false;
+  }
+  wf->header = *h;
+  wf->peaks = (const WaveformPeak*)(wf->map.data + sizeof(WaveformHeader));
+  return true;
+}
+
+static void waveform_save(Waveform* wf) {
+  FILE* f = fopen(wf->cachepath, "wb");
+  if (f == NULL) {
+    return;
+  }
+  fwrite(&wf->header, sizeof(wf->header), 1, f);
+  fwrite(wf->built, sizeof(WaveformPeak), wf->num_built, f);
+  fclose(f);
+}
+
+static WaveformPeak waveform_quantize(float min, float max, float sumsq, int num) {
+  float rms = num ? sqrtf(sumsq / (float)num) : 0.0f;
+  return (WaveformPeak){.min = (int8_t)lrintf(fmaxf(min, -1.0f) * 127.0f),
+                        .max = (int8_t)lrintf(fminf(max, 1.0f) * 127.0f),
+                        .rms = (uint8_t)lrintf(fminf(rms, 1.0f) * 255.0f)};
+}
+
+// each level above 0 merges WAVEFORM_LEVEL_FACTOR peaks of the one below, until a level fits in a single peak
+static void waveform_buildlevels(Waveform* wf) {
+  WaveformHeader* h = &wf->header;
+  h->num_levels = 1;
+  h->offsets[0] = 0;
+  h->nums[0] = wf->num_built;
+  while (h->num_levels < WAVEFORM_MAX_LEVELS && h->nums[h->num_levels - 1] > 1) {
+    int below = h->offsets[h->num_levels - 1], num_below = h->nums[h->num_levels - 1];
+    h->offsets[h->num_levels] = wf->num_built;
+    for (int i = 0; i < num_below; i += WAVEFORM_LEVEL_FACTOR) {
+      int end = i + WAVEFORM_LEVEL_FACTOR < num_below ? i + WAVEFORM_LEVEL_FACTOR : num_below;
+      WaveformPeak p = wf->built[below + i];
+      float sumsq = 0.0f;
+      for (int j = i; j < end; j++) {
+        const WaveformPeak* q = &wf->built[below + j];
+        p.min = q->min < p.min ? q->min : p.min;
+        p.max = q->max > p.max ? q->max : p.max;
+        sumsq += (float)q->rms * (float)q->rms;
+      }
+      p.rms = (uint8_t)lrintf(sqrtf(sumsq / (float)(end - i)));
+      waveform_push(wf, p); // may move built, so nothing points into it across this
+    }
+    h->nums[h->num_levels] = wf->num_built - h->offsets[h->num_levels];
+    h->num_levels++;
+  }
+}
+
+// decodes the audio stream and accumulates level 0, then builds the levels above it
+static bool waveform_scan(Waveform* wf) {
+  AVFormatContext* fmt_ctx = NULL;
+  AVCodecContext* codec_ctx = NULL;
+  AudioConvert* convert = NULL;
+  AVPacket* packet = av_packet_alloc();
+  AVFrame* frame = av_frame_alloc();
+  bool ok = false;
+  if (avformat_open_input(&fmt_ctx, wf->path, NULL, NULL) != 0) {
+    goto cleanup;
+  }
+  if ((int)fmt_ctx->nb_streams <= wf->streamidx && avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+    goto cleanup;
+  }
+  if ((int)fmt_ctx->nb_streams <= wf->streamidx) {
+    goto cleanup;
+  }
+  AVStream* stream = fmt_ctx->streams[wf->streamidx];
+  const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+  codec_ctx = codec ? avcodec_alloc_context3(codec) : NULL;
+  if (codec_ctx == NULL || avcodec_parameters_to_context(codec_ctx, stream->codecpar) != 0) {
+    goto cleanup;
+  }
+  codec_ctx->thread_count = 1;
+  if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+    goto cleanup;
+  }
+  for (int i = 0; i < (int)fmt_ctx->nb_streams; i++) {
+    fmt_ctx->streams[i]->discard = i == wf->streamidx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+  convert = audioconvert_create();
+  int sample_rate = codec_ctx->sample_rate;
+  float min = 0.0f, max = 0.0f, sumsq = 0.0f;
+  int inpeak = 0;
+  bool cancelled = false;
+  while (!cancelled && av_read_frame(fmt_ctx, packet) >= 0) {
+    if (packet->stream_index == wf->streamidx && avcodec_send_packet(codec_ctx, packet) >= 0) {
+      while (avcodec_receive_frame(codec_ctx, frame) >= 0) {
+        const float* mono;
+        int num = audioconvert_frame(convert, frame, sample_rate, 1, &mono);
+        for (int i = 0; i < num; i++) {
+          float x = mono[i];
+          min = inpeak ? fminf(min, x) : x;
+          max = inpeak ? fmaxf(max, x) : x;
+          sumsq += x * x;
+          if (++inpeak == WAVEFORM_BASE_FRAMES) {
+            waveform_push(wf, waveform_quantize(min, max, sumsq, inpeak));
+            sumsq = 0.0f;
+            inpeak = 0;
+          }
+        }
+        av_frame_unref(frame);
+      }
+    }
+    av_packet_unref(packet);
+    cancelled = thread_atomic_int_load(&wf->cancel) != 0;
+  }
+  if (inpeak > 0) {
+    waveform_push(wf, waveform_quantize(min, max, sumsq, inpeak));
+  }
+  if (!cancelled && wf->num_built > 0 && sample_rate > 0) {
+    wf->header = (WaveformHeader){.magic = WAVEFORM_MAGIC,
+                                  .version = WAVEFORM_VERSION,
+                                  .size = wf->fp.size,
+                                  .mtime = wf->fp.mtime,
+                                  .streamidx = wf->streamidx,
+                                  .sample_rate = sample_rate};
+    snprintf(wf->header.path, sizeof(wf->header.path), "%s", wf->path);
+    waveform_buildlevels(wf);
+    wf->peaks = wf->built;
+    ok = true;
+  }
+cleanup:
+  audioconvert_free(convert);
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+  if (codec_ctx) {
+    avcodec_free_context(&codec_ctx);
+  }
+  if (fmt_ctx) {
+    avformat_close_input(&fmt_ctx);
+  }
+  return ok;
+}
+
+static int waveform_thread(void* user_data) {
+  Waveform* wf = (Waveform*)user_data;
+  if (waveform_load(wf)) {
+    thread_atomic_int_store(&wf->ready, 1);
+  } else if (waveform_scan(wf)) {
+    waveform_save(wf);
+    thread_atomic_int_store(&wf->ready, 1);
+  }
+  return 0;
+}
+
+Waveform* waveform_open(const char* path, int streamidx) {
+  Waveform* wf = (Waveform*)calloc(1, sizeof(Waveform));
+  assert(wf);
+  snprintf(wf->path, sizeof(wf->path), "%s", path);
+  wf->streamidx = streamidx;
+  if (!filecache_fingerprint(path, &wf->fp) || !filecache_path(path, "fswav", wf->cachepath, sizeof(wf->cachepath))) {
+    return wf; // never becomes ready, clips are drawn without a waveform
+  }
+  thread_atomic_int_store(&wf->ready, 0);
+  thread_atomic_int_store(&wf->cancel, 0);
+  wf->thread = thread_create(waveform_thread, wf, "waveform", THREAD_STACK_SIZE_DEFAULT);
+  return wf;
+}
+
+void waveform_free(Waveform* wf) {
+  if (wf == NULL) {
+    return;
+  }
+  if (wf->thread) {
+    thread_atomic_int_store(&wf->cancel, 1);
+    thread_join(wf->thread);
+    thread_destroy(wf->thread);
+  }
+  filecache_unmap(&wf->map);
+  free(wf->built);
+  free(wf);
+}
+
+bool waveform_ready(Waveform* wf) {
+  return wf && thread_atomic_int_load(&wf->ready);
+}
+
+const WaveformPeak* waveform_level(Waveform* wf, double max_peak_secs, int* num, double* peak_secs) {
+  if (!waveform_ready(wf)) {
+    return NULL;
+  }
+  const WaveformHeader* h = &wf->header;
+  double secs = (double)WAVEFORM_BASE_FRAMES / h->sample_rate;
+  int level = 0;
+  while (level + 1 < h->num_levels && secs * WAVEFORM_LEVEL_FACTOR <= max_peak_secs) {
+    secs *= WAVEFORM_LEVEL_FACTOR;
+    level++;
+  }
+  *num = h->nums[level];
+  *peak_secs = secs;
+  return wf->peaks + h->offsets[level];
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// min/max/rms peaks of a file's audio, mixed down to mono, at several resolutions. level 0 has a peak per
+// WAVEFORM_BASE_FRAMES frames and each level above merges WAVEFORM_LEVEL_FACTOR peaks of the one below. they're built
+// by decoding the audio on a background thread and saved to a cache file, which is mapped straight back in next time
+
+#define WAVEFORM_BASE_FRAMES (256)
+#define WAVEFORM_LEVEL_FACTOR (4)
+#define WAVEFORM_MAX_LEVELS (12)
+
+typedef struct {
+  int8_t min, max; // -127..127 is -1..1
+  uint8_t rms;     // 0..255 is 0..1
+  uint8_t pad;
+} WaveformPeak;
+
+typedef struct Waveform Waveform;
+
+// loads the peaks of the audio stream 'streamidx' from the cache, or builds them on a background thread
+Waveform* waveform_open(const char* path, int streamidx);
+void waveform_free(Waveform* wf);
+bool waveform_ready(Waveform* wf);
+
+// the coarsest level whose peaks each cover at most 'max_peak_secs', NULL until the waveform is ready. *num is the
+// number of peaks and *peak_secs the time each one covers
+const WaveformPeak* waveform_level(Waveform* wf, double max_peak_secs, int* num, double* peak_secs);
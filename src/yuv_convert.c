@@ -0,0 +1,493 @@
+#include "yuv_convert.h"
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <thread/thread.h>
+#include <assert.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define YUV_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#define YUV_INLINE static __forceinline
+#define YUV_AVX2
+#else
+#define YUV_INLINE static inline __attribute__((always_inline))
+#define YUV_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef enum {
+  YuvFormat_420p,
+  YuvFormat_422p,
+  YuvFormat_Nv12,
+  YuvFormat_420p10,
+  YuvFormat_422p10,
+  YuvFormat_P010,
+  YuvFormat_Count,
+} YuvFormat;
+
+static int yuvconvert_format(int pix_fmt) {
+  switch (pix_fmt) {
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+    return YuvFormat_420p;
+  case AV_PIX_FMT_YUV422P:
+  case AV_PIX_FMT_YUVJ422P:
+    return YuvFormat_422p;
+  case AV_PIX_FMT_NV12:
+    return YuvFormat_Nv12;
+  case AV_PIX_FMT_YUV420P10LE:
+    return YuvFormat_420p10;
+  case AV_PIX_FMT_YUV422P10LE:
+    return YuvFormat_422p10;
+  case AV_PIX_FMT_P010LE:
+    return YuvFormat_P010;
+  default:
+    return -1;
+  }
+}
+
+// samples are normalized to 8-bit values * 64 so every format shares the same 16-bit fixed point maths, and
+// coefficients are * 1024 so mulhi brings the result back to 8 bits. yoff is the normalized black level, 16 * 64 for
+// limited range and 0 for full range
+typedef struct {
+  int16_t cy, crv, cgu, cgv, cbu, yoff;
+} YuvCoeffs;
+
+YUV_INLINE bool yuv_vsub(YuvFormat fmt) {
+  return fmt == YuvFormat_420p || fmt == YuvFormat_Nv12 || fmt == YuvFormat_420p10 || fmt == YuvFormat_P010;
+}
+YUV_INLINE bool yuv_semiplanar(YuvFormat fmt) {
+  return fmt == YuvFormat_Nv12 || fmt == YuvFormat_P010;
+}
+YUV_INLINE bool yuv_deep(YuvFormat fmt) {
+  return fmt == YuvFormat_420p10 || fmt == YuvFormat_422p10 || fmt == YuvFormat_P010;
+}
+
+typedef struct {
+  const uint8_t* src[3];
+  int src_linesize[3];
+  uint8_t* dst;
+  int dst_linesize;
+  int width, y0, y1;
+  YuvCoeffs k;
+} YuvSlice;
+
+typedef void (*YuvSliceFunc)(const YuvSlice* s);
+
+YUV_INLINE int yuv_mulhi(int a, int b) {
+  return (a * b) >> 16;
+}
+YUV_INLINE uint8_t yuv_clamp(int x) {
+  return (uint8_t)(x < 0 ? 0 : x > 255 ? 255 : x);
+}
+
+// also converts the pixels left over at the end of a row by the SIMD kernels, so it has to match them exactly
+YUV_INLINE void yuv_row_scalar(const uint8_t* yp, const uint8_t* up, const uint8_t* vp, uint8_t* dst, int x, int width,
+                               const YuvCoeffs* k, YuvFormat fmt) {
+  for (; x < width; x++) {
+    int cx = x >> 1, y, u, v;
+    if (fmt == YuvFormat_P010) {
+      y = (((const uint16_t*)yp)[x] >> 2) - k->yoff;
+      u = (((const uint16_t*)up)[cx * 2] >> 2) - 8192;
+      v = (((const uint16_t*)up)[cx * 2 + 1] >> 2) - 8192;
+    } else if (yuv_deep(fmt)) {
+      y = ((const uint16_t*)yp)[x] * 16 - k->yoff;
+      u = (((const uint16_t*)up)[cx] - 512) * 16;
+      v = (((const uint16_t*)vp)[cx] - 512) * 16;
+    } else if (yuv_semiplanar(fmt)) {
+      y = yp[x] * 64 - k->yoff;
+      u = (up[cx * 2] - 128) * 64;
+      v = (up[cx * 2 + 1] - 128) * 64;
+    } else {
+      y = yp[x] * 64 - k->yoff;
+      u = (up[cx] - 128) * 64;
+      v = (vp[cx] - 128) * 64;
+    }
+    int yt = yuv_mulhi(y, k->cy);
+    dst[x * 4 + 0] = yuv_clamp(yt + yuv_mulhi(v, k->crv));
+    dst[x * 4 + 1] = yuv_clamp(yt - (yuv_mulhi(u, k->cgu) + yuv_mulhi(v, k->cgv)));
+    dst[x * 4 + 2] = yuv_clamp(yt + yuv_mulhi(u, k->cbu));
+    dst[x * 4 + 3] = 255;
+  }
+}
+
+YUV_INLINE void yuv_rowpointers(const YuvSlice* s, int y, YuvFormat fmt, const uint8_t** yp, const uint8_t** up,
+                                const uint8_t** vp, uint8_t** dst) {
+  int cy = yuv_vsub(fmt) ? y >> 1 : y;
+  *yp = s->src[0] + (ptrdiff_t)y * s->src_linesize[0];
+  *up = s->src[1] + (ptrdiff_t)cy * s->src_linesize[1];
+  *vp = yuv_semiplanar(fmt) ? NULL : s->src[2] + (ptrdiff_t)cy * s->src_linesize[2];
+  *dst = s->dst + (ptrdiff_t)y * s->dst_linesize;
+}
+
+YUV_INLINE void yuv_slice_scalar(const YuvSlice* s, YuvFormat fmt) {
+  for (int y = s->y0; y < s->y1; y++) {
+    const uint8_t *yp, *up, *vp;
+    uint8_t* dst;
+    yuv_rowpointers(s, y, fmt, &yp, &up, &vp, &dst);
+    yuv_row_scalar(yp, up, vp, dst, 0, s->width, &s->k, fmt);
+  }
+}
+
+#ifdef YUV_X86
+
+// interleaves 16 pixels of 16-bit R, G and B (low 8 pixels in *l, high 8 in *h) into RGBA
+YUV_INLINE void yuv_store16_sse2(uint8_t* dst, __m128i rl, __m128i rh, __m128i gl, __m128i gh, __m128i bl,
+                                 __m128i bh) {
+  __m128i r = _mm_packus_epi16(rl, rh);
+  __m128i g = _mm_packus_epi16(gl, gh);
+  __m128i b = _mm_packus_epi16(bl, bh);
+  __m128i a = _mm_set1_epi8(-1);
+  __m128i rglo = _mm_unpacklo_epi8(r, g), rghi = _mm_unpackhi_epi8(r, g);
+  __m128i balo = _mm_unpacklo_epi8(b, a), bahi = _mm_unpackhi_epi8(b, a);
+  _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rglo, balo));
+  _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(rglo, balo));
+  _mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(rghi, bahi));
+  _mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(rghi, bahi));
+}
+
+// 16 pixels per iteration: two vectors of 8 luma samples and one of 8 chroma samples each for u and v
+YUV_INLINE void yuv_row_sse2(const uint8_t* yp, const uint8_t* up, const uint8_t* vp, uint8_t* dst, int width,
+                             const YuvCoeffs* k, YuvFormat fmt) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i cy = _mm_set1_epi16(k->cy), crv = _mm_set1_epi16(k->crv), cgu = _mm_set1_epi16(k->cgu),
+                cgv = _mm_set1_epi16(k->cgv), cbu = _mm_set1_epi16(k->cbu), yoff = _mm_set1_epi16(k->yoff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i y0, y1, u, v;
+    if (fmt == YuvFormat_P010) {
+      const __m128i coff = _mm_set1_epi16(8192);
+      y0 = _mm_sub_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(yp + x * 2)), 2), yoff);
+      y1 = _mm_sub_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(yp + x * 2 + 16)), 2), yoff);
+      __m128i uva = _mm_loadu_si128((const __m128i*)(up + x * 2));
+      __m128i uvb = _mm_loadu_si128((const __m128i*)(up + x * 2 + 16));
+      u = _mm_packs_epi32(_mm_srli_epi32(_mm_slli_epi32(uva, 16), 18), _mm_srli_epi32(_mm_slli_epi32(uvb, 16), 18));
+      v = _mm_packs_epi32(_mm_srli_epi32(uva, 18), _mm_srli_epi32(uvb, 18));
+      u = _mm_sub_epi16(u, coff);
+      v = _mm_sub_epi16(v, coff);
+    } else if (yuv_deep(fmt)) {
+      const __m128i coff = _mm_set1_epi16(512);
+      y0 = _mm_sub_epi16(_mm_slli_epi16(_mm_loadu_si128((const __m128i*)(yp + x * 2)), 4), yoff);
+      y1 = _mm_sub_epi16(_mm_slli_epi16(_mm_loadu_si128((const __m128i*)(yp + x * 2 + 16)), 4), yoff);
+      u = _mm_slli_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i*)(up + x)), coff), 4);
+      v = _mm_slli_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i*)(vp + x)), coff), 4);
+    } else {
+      const __m128i coff = _mm_set1_epi16(128);
+      __m128i ys = _mm_loadu_si128((const __m128i*)(yp + x));
+      y0 = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(ys, zero), 6), yoff);
+      y1 = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(ys, zero), 6), yoff);
+      if (yuv_semiplanar(fmt)) {
+        __m128i uv = _mm_loadu_si128((const __m128i*)(up + x));
+        u = _mm_and_si128(uv, _mm_set1_epi16(0xff));
+        v = _mm_srli_epi16(uv, 8);
+      } else {
+        u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(up + x / 2)), zero);
+        v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(vp + x / 2)), zero);
+      }
+      u = _mm_slli_epi16(_mm_sub_epi16(u, coff), 6);
+      v = _mm_slli_epi16(_mm_sub_epi16(v, coff), 6);
+    }
+    __m128i r = _mm_mulhi_epi16(v, crv);
+    __m128i g = _mm_add_epi16(_mm_mulhi_epi16(u, cgu), _mm_mulhi_epi16(v, cgv));
+    __m128i b = _mm_mulhi_epi16(u, cbu);
+    __m128i yl = _mm_mulhi_epi16(y0, cy), yh = _mm_mulhi_epi16(y1, cy);
+    // each chroma sample covers two pixels
+    yuv_store16_sse2(dst + x * 4, _mm_add_epi16(yl, _mm_unpacklo_epi16(r, r)),
+                     _mm_add_epi16(yh, _mm_unpackhi_epi16(r, r)), _mm_sub_epi16(yl, _mm_unpacklo_epi16(g, g)),
+                     _mm_sub_epi16(yh, _mm_unpackhi_epi16(g, g)), _mm_add_epi16(yl, _mm_unpacklo_epi16(b, b)),
+                     _mm_add_epi16(yh, _mm_unpackhi_epi16(b, b)));
+  }
+  yuv_row_scalar(yp, up, vp, dst, x, width, k, fmt);
+}
+
+YUV_INLINE void yuv_slice_sse2(const YuvSlice* s, YuvFormat fmt) {
+  for (int y = s->y0; y < s->y1; y++) {
+    const uint8_t *yp, *up, *vp;
+    uint8_t* dst;
+    yuv_rowpointers(s, y, fmt, &yp, &up, &vp, &dst);
+    yuv_row_sse2(yp, up, vp, dst, s->width, &s->k, fmt);
+  }
+}
+
+// duplicates 16 chroma terms into the two halves of 32 pixels
+YUV_INLINE YUV_AVX2 void yuv_dup_avx2(__m256i c, __m256i* lo, __m256i* hi) {
+  __m256i a = _mm256_unpacklo_epi16(c, c), b = _mm256_unpackhi_epi16(c, c);
+  *lo = _mm256_permute2x128_si256(a, b, 0x20);
+  *hi = _mm256_permute2x128_si256(a, b, 0x31);
+}
+
+// 32 pixels per iteration, same maths as the SSE2 version
+YUV_INLINE YUV_AVX2 void yuv_row_avx2(const uint8_t* yp, const uint8_t* up, const uint8_t* vp, uint8_t* dst,
+                                      int width, const YuvCoeffs* k, YuvFormat fmt) {
+  const __m256i cy = _mm256_set1_epi16(k->cy), crv = _mm256_set1_epi16(k->crv), cgu = _mm256_set1_epi16(k->cgu),
+                cgv = _mm256_set1_epi16(k->cgv), cbu = _mm256_set1_epi16(k->cbu), yoff = _mm256_set1_epi16(k->yoff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i y0, y1, u, v;
+    if (fmt == YuvFormat_P010) {
+      const __m256i coff = _mm256_set1_epi16(8192);
+      y0 = _mm256_sub_epi16(_mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(yp + x * 2)), 2), yoff);
+      y1 = _mm256_sub_epi16(_mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(yp + x * 2 + 32)), 2), yoff);
+      __m256i uva = _mm256_loadu_si256((const __m256i*)(up + x * 2));
+      __m256i uvb = _mm256_loadu_si256((const __m256i*)(up + x * 2 + 32));
+      // packs works within 128-bit lanes, put the halves back in order afterwards
+      u = _mm256_packs_epi32(_mm256_srli_epi32(_mm256_slli_epi32(uva, 16), 18),
+                             _mm256_srli_epi32(_mm256_slli_epi32(uvb, 16), 18));
+      v = _mm256_packs_epi32(_mm256_srli_epi32(uva, 18), _mm256_srli_epi32(uvb, 18));
+      u = _mm256_sub_epi16(_mm256_permute4x64_epi64(u, 0xd8), coff);
+      v = _mm256_sub_epi16(_mm256_permute4x64_epi64(v, 0xd8), coff);
+    } else if (yuv_deep(fmt)) {
+      const __m256i coff = _mm256_set1_epi16(512);
+      y0 = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)(yp + x * 2)), 4), yoff);
+      y1 = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)(yp + x * 2 + 32)), 4), yoff);
+      u = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(up + x)), coff), 4);
+      v = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(vp + x)), coff), 4);
+    } else {
+      const __m256i coff = _mm256_set1_epi16(128);
+      y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(yp + x)));
+      y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(yp + x + 16)));
+      y0 = _mm256_sub_epi16(_mm256_slli_epi16(y0, 6), yoff);
+      y1 = _mm256_sub_epi16(_mm256_slli_epi16(y1, 6), yoff);
+      if (yuv_semiplanar(fmt)) {
+        __m256i uv = _mm256_loadu_si256((const __m256i*)(up + x));
+        u = _mm256_and_si256(uv, _mm256_set1_epi16(0xff));
+        v = _mm256_srli_epi16(uv, 8);
+      } else {
+        u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(up + x / 2)));
+        v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(vp + x / 2)));
+      }
+      u = _mm256_slli_epi16(_mm256_sub_epi16(u, coff), 6);
+      v = _mm256_slli_epi16(_mm256_sub_epi16(v, coff), 6);
+    }
+    __m256i rlo, rhi, glo, ghi, blo, bhi;
+    yuv_dup_avx2(_mm256_mulhi_epi16(v, crv), &rlo, &rhi);
+    yuv_dup_avx2(_mm256_add_epi16(_mm256_mulhi_epi16(u, cgu), _mm256_mulhi_epi16(v, cgv)), &glo, &ghi);
+    yuv_dup_avx2(_mm256_mulhi_epi16(u, cbu), &blo, &bhi);
+    __m256i yl = _mm256_mulhi_epi16(y0, cy), yh = _mm256_mulhi_epi16(y1, cy);
+    __m256i r0 = _mm256_add_epi16(yl, rlo), r1 = _mm256_add_epi16(yh, rhi);
+    __m256i g0 = _mm256_sub_epi16(yl, glo), g1 = _mm256_sub_epi16(yh, ghi);
+    __m256i b0 = _mm256_add_epi16(yl, blo), b1 = _mm256_add_epi16(yh, bhi);
+    yuv_store16_sse2(dst + x * 4, _mm256_castsi256_si128(r0), _mm256_extracti128_si256(r0, 1),
+                     _mm256_castsi256_si128(g0), _mm256_extracti128_si256(g0, 1), _mm256_castsi256_si128(b0),
+                     _mm256_extracti128_si256(b0, 1));
+    yuv_store16_sse2(dst + x * 4 + 64, _mm256_castsi256_si128(r1), _mm256_extracti128_si256(r1, 1),
+                     _mm256_castsi256_si128(g1), _mm256_extracti128_si256(g1, 1), _mm256_castsi256_si128(b1),
+                     _mm256_extracti128_si256(b1, 1));
+  }
+  yuv_row_scalar(yp, up, vp, dst, x, width, k, fmt);
+}
+
+YUV_INLINE YUV_AVX2 void yuv_slice_avx2(const YuvSlice* s, YuvFormat fmt) {
+  for (int y = s->y0; y < s->y1; y++) {
+    const uint8_t *yp, *up, *vp;
+    uint8_t* dst;
+    yuv_rowpointers(s, y, fmt, &yp, &up, &vp, &dst);
+    yuv_row_avx2(yp, up, vp, dst, s->width, &s->k, fmt);
+  }
+}
+
+// one copy of each kernel per format so the format checks all fold away
+#define YUV_KERNELS(fmt)                                                                                               \
+  static void yuv_slice_sse2_##fmt(const YuvSlice* s) {                                                                \
+    yuv_slice_sse2(s, YuvFormat_##fmt);                                                                                \
+  }                                                                                                                    \
+  static YUV_AVX2 void yuv_slice_avx2_##fmt(const YuvSlice* s) {                                                       \
+    yuv_slice_avx2(s, YuvFormat_##fmt);                                                                                \
+  }
+YUV_KERNELS(420p)
+YUV_KERNELS(422p)
+YUV_KERNELS(Nv12)
+YUV_KERNELS(420p10)
+YUV_KERNELS(422p10)
+YUV_KERNELS(P010)
+
+static const YuvSliceFunc yuv_kernels_sse2[YuvFormat_Count] = {
+    yuv_slice_sse2_420p,   yuv_slice_sse2_422p,   yuv_slice_sse2_Nv12,
+    yuv_slice_sse2_420p10, yuv_slice_sse2_422p10, yuv_slice_sse2_P010,
+};
+static const YuvSliceFunc yuv_kernels_avx2[YuvFormat_Count] = {
+    yuv_slice_avx2_420p,   yuv_slice_avx2_422p,   yuv_slice_avx2_Nv12,
+    yuv_slice_avx2_420p10, yuv_slice_avx2_422p10, yuv_slice_avx2_P010,
+};
+
+static bool yuvconvert_hasavx2(void) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  __cpuidex(info, 7, 0);
+  // the OS also has to save the upper halves of the ymm registers
+  return osxsave && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+#define YUV_KERNELS(fmt)                                                                                               \
+  static void yuv_slice_scalar_##fmt(const YuvSlice* s) {                                                              \
+    yuv_slice_scalar(s, YuvFormat_##fmt);                                                                              \
+  }
+YUV_KERNELS(420p)
+YUV_KERNELS(422p)
+YUV_KERNELS(Nv12)
+YUV_KERNELS(420p10)
+YUV_KERNELS(422p10)
+YUV_KERNELS(P010)
+
+static const YuvSliceFunc yuv_kernels_scalar[YuvFormat_Count] = {
+    yuv_slice_scalar_420p,   yuv_slice_scalar_422p,   yuv_slice_scalar_Nv12,
+    yuv_slice_scalar_420p10, yuv_slice_scalar_422p10, yuv_slice_scalar_P010,
+};
+
+#endif
+
+// slices smaller than this aren't worth waking a thread for
+#define YUVCONVERT_MIN_SLICE_ROWS (64)
+
+typedef struct {
+  thread_ptr_t thread;
+  thread_signal_t start, done;
+  YuvSliceFunc func;
+  YuvSlice slice;
+} YuvWorker;
+
+typedef struct {
+  bool init;
+  const YuvSliceFunc* kernels;
+  YuvCoeffs coeffs[2][2]; // [bt709][full_range]
+  YuvWorker workers[YUVCONVERT_MAX_THREADS];
+  int num_workers;
+  thread_atomic_int_t busy, exit;
+} YuvConvert;
+static YuvConvert _yuvconvert;
+
+// the same matrix as the yuv shader: limited range is stretched from 16..235 (luma) and 16..240 (chroma)
+static YuvCoeffs yuvconvert_coeffs(bool bt709, bool full_range) {
+  double kr = bt709 ? 0.2126 : 0.299, kb = bt709 ? 0.0722 : 0.114, kg = 1.0 - kr - kb;
+  double ys = full_range ? 1.0 : 255.0 / 219.0, cs = full_range ? 1.0 : 255.0 / 224.0;
+  return (YuvCoeffs){
+      .cy = (int16_t)lround(ys * 1024.0),
+      .crv = (int16_t)lround(2.0 * (1.0 - kr) * cs * 1024.0),
+      .cgu = (int16_t)lround(2.0 * kb * (1.0 - kb) / kg * cs * 1024.0),
+      .cgv = (int16_t)lround(2.0 * kr * (1.0 - kr) / kg * cs * 1024.0),
+      .cbu = (int16_t)lround(2.0 * (1.0 - kb) * cs * 1024.0),
+      .yoff = full_range ? 0 : 16 * 64,
+  };
+}
+
+static int yuvconvert_thread(void* user_data) {
+  YuvWorker* w = (YuvWorker*)user_data;
+  while (thread_atomic_int_load(&_yuvconvert.exit) == 0) {
+    if (!thread_signal_wait(&w->start, 100) || thread_atomic_int_load(&_yuvconvert.exit)) {
+      continue;
+    }
+    w->func(&w->slice);
+    thread_signal_raise(&w->done);
+  }
+  return 0;
+}
+
+void yuvconvert_init(int num_threads) {
+  YuvConvert* c = &_yuvconvert;
+  assert(!c->init);
+  c->init = true;
+#ifdef YUV_X86
+  c->kernels = yuvconvert_hasavx2() ? yuv_kernels_avx2 : yuv_kernels_sse2;
+#else
+  c->kernels = yuv_kernels_scalar;
+#endif
+  for (int bt709 = 0; bt709 < 2; bt709++) {
+    for (int full = 0; full < 2; full++) {
+      c->coeffs[bt709][full] = yuvconvert_coeffs(bt709, full);
+    }
+  }
+  thread_atomic_int_store(&c->busy, 0);
+  thread_atomic_int_store(&c->exit, 0);
+  // the thread converting the frame does a slice itself
+  c->num_workers = num_threads < YUVCONVERT_MAX_THREADS ? num_threads : YUVCONVERT_MAX_THREADS;
+  for (int i = 0; i < c->num_workers; i++) {
+    YuvWorker* w = &c->workers[i];
+    thread_signal_init(&w->start);
+    thread_signal_init(&w->done);
+    w->thread = thread_create(yuvconvert_thread, w, "yuv convert", THREAD_STACK_SIZE_DEFAULT);
+  }
+}
+
+void yuvconvert_shutdown(void) {
+  YuvConvert* c = &_yuvconvert;
+  if (!c->init) {
+    return;
+  }
+  c->init = false;
+  // decode threads can still be converting, wait for the workers to be free and keep them busy from then on
+  while (thread_atomic_int_compare_and_swap(&c->busy, 0, 1) != 0) {
+    thread_yield();
+  }
+  thread_atomic_int_store(&c->exit, 1);
+  for (int i = 0; i < c->num_workers; i++) {
+    YuvWorker* w = &c->workers[i];
+    thread_signal_raise(&w->start);
+    thread_join(w->thread);
+    thread_destroy(w->thread);
+    thread_signal_term(&w->start);
+    thread_signal_term(&w->done);
+  }
+  c->num_workers = 0;
+}
+
+bool yuvconvert_frame(const struct AVFrame* frame, bool bt709, bool full_range, uint8_t* dst, int dst_linesize) {
+  YuvConvert* c = &_yuvconvert;
+  int fmt = yuvconvert_format(frame->format);
+  if (!c->init || fmt < 0) {
+    return false;
+  }
+  YuvSliceFunc func = c->kernels[fmt];
+  YuvSlice whole = {
+      .src = {frame->data[0], frame->data[1], frame->data[2]},
+      .src_linesize = {frame->linesize[0], frame->linesize[1], frame->linesize[2]},
+      .dst = dst,
+      .dst_linesize = dst_linesize,
+      .width = frame->width,
+      .y0 = 0,
+      .y1 = frame->height,
+      .k = c->coeffs[bt709][full_range],
+  };
+  int num_slices = frame->height / YUVCONVERT_MIN_SLICE_ROWS;
+  if (num_slices > c->num_workers + 1) {
+    num_slices = c->num_workers + 1;
+  }
+  // the pool does one frame at a time, anyone else converting at the same moment just does it on their own thread
+  if (num_slices < 2 || thread_atomic_int_compare_and_swap(&c->busy, 0, 1) != 0) {
+    func(&whole);
+    return true;
+  }
+  for (int i = 1; i < num_slices; i++) {
+    YuvWorker* w = &c->workers[i - 1];
+    w->func = func;
+    w->slice = whole;
+    w->slice.y0 = frame->height * i / num_slices;
+    w->slice.y1 = frame->height * (i + 1) / num_slices;
+    thread_signal_raise(&w->start);
+  }
+  whole.y1 = frame->height / num_slices;
+  func(&whole);
+  for (int i = 1; i < num_slices; i++) {
+    thread_signal_wait(&c->workers[i - 1].done, -1);
+  }
+  thread_atomic_int_store(&c->busy, 0);
+  return true;
+}
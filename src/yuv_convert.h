@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// converts decoded frames to RGBA with SSE2/AVX2 kernels for yuv420p, yuv422p, nv12 and their 10-bit variants, in
+// BT.601 or BT.709 and limited or full range. each frame is split into row slices that are converted in parallel on a
+// small pool of worker threads. anything else (other formats, scaling) still has to go through sws_scale
+
+#define YUVCONVERT_MAX_THREADS (16)
+
+void yuvconvert_init(int num_threads);
+void yuvconvert_shutdown(void);
+
+struct AVFrame;
+// converts a frame to RGBA at the same size with the BT.709 matrix (else BT.601) and full range (else limited), returns
+// false if its format isn't supported
+bool yuvconvert_frame(const struct AVFrame* frame, bool bt709, bool full_range, uint8_t* dst, int dst_linesize);
@@ -0,0 +1,70 @@
+// samples per second through audioconvert_frame for the layouts and formats decoders hand out, downmixed to the
+// stereo the mixer wants. also checks the downmix levels: front channels at unity, centre and surrounds at -3dB
+#include "test_common.h"
+#include "audio_convert.h"
+#include <libavutil/frame.h>
+#include <libavutil/channel_layout.h>
+#include <math.h>
+#include <string.h>
+
+#define BENCH_RATE (48000)
+#define BENCH_FRAME_SAMPLES (1024) // an AAC frame
+
+static AVFrame* bench_frame(const AVChannelLayout* layout, enum AVSampleFormat format) {
+  AVFrame* f = av_frame_alloc();
+  f->format = format;
+  f->sample_rate = BENCH_RATE;
+  f->nb_samples = BENCH_FRAME_SAMPLES;
+  av_channel_layout_copy(&f->ch_layout, layout);
+  TEST_CHECK(av_frame_get_buffer(f, 0) == 0);
+  for (int p = 0; p < 8 && f->buf[p]; p++) {
+    memset(f->buf[p]->data, 0, f->buf[p]->size);
+  }
+  return f;
+}
+
+// plays 'level' on a single channel of a planar float 5.1 frame and returns what comes out on the left
+static float bench_gain(AudioConvert* c, enum AVChannel channel, float level) {
+  AVChannelLayout layout = AV_CHANNEL_LAYOUT_5POINT1;
+  AVFrame* f = bench_frame(&layout, AV_SAMPLE_FMT_FLTP);
+  int idx = av_channel_layout_index_from_channel(&layout, channel);
+  for (int i = 0; i < BENCH_FRAME_SAMPLES; i++) {
+    ((float*)f->extended_data[idx])[i] = level;
+  }
+  const float* out;
+  TEST_CHECK(audioconvert_frame(c, f, BENCH_RATE, 2, &out) == BENCH_FRAME_SAMPLES);
+  float left = out[0];
+  av_frame_free(&f);
+  return left;
+}
+
+static void bench_layout(AudioConvert* c, AVChannelLayout layout, enum AVSampleFormat format, const char* name) {
+  AVFrame* f = bench_frame(&layout, format);
+  int iterations = test_iterations(20000);
+  const float* out;
+  double t = test_secs();
+  for (int i = 0; i < iterations; i++) {
+    audioconvert_frame(c, f, BENCH_RATE, 2, &out);
+  }
+  t = test_secs() - t;
+  // input samples, one per channel per frame
+  test_report(name, (double)BENCH_FRAME_SAMPLES * layout.nb_channels * iterations / t / 1e6, "Msamples/sec");
+  av_frame_free(&f);
+}
+
+int main(void) {
+  test_init();
+  AudioConvert* c = audioconvert_create();
+  TEST_CHECK(fabsf(bench_gain(c, AV_CHAN_FRONT_LEFT, 0.5f) - 0.5f) < 1e-6f);
+  TEST_CHECK(fabsf(bench_gain(c, AV_CHAN_FRONT_CENTER, 0.5f) - 0.5f * 0.70710678f) < 1e-6f);
+  TEST_CHECK(fabsf(bench_gain(c, AV_CHAN_SIDE_LEFT, 0.5f) - 0.5f * 0.70710678f) < 1e-6f);
+  TEST_CHECK(bench_gain(c, AV_CHAN_LOW_FREQUENCY, 0.5f) == 0.0f);
+
+  bench_layout(c, (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, "stereo s16");
+  bench_layout(c, (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, "stereo fltp");
+  bench_layout(c, (AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1, AV_SAMPLE_FMT_FLTP, "5.1 fltp");
+  bench_layout(c, (AVChannelLayout)AV_CHANNEL_LAYOUT_5POINT1, AV_SAMPLE_FMT_S32, "5.1 s32");
+  bench_layout(c, (AVChannelLayout)AV_CHANNEL_LAYOUT_7POINT1, AV_SAMPLE_FMT_FLTP, "7.1 fltp");
+  audioconvert_free(c);
+  return 0;
+}
@@ -0,0 +1,69 @@
+// how fast the audio thread mixes 1 to AUDIO_MAX_SOURCES clips into the ring, with the decoding stubbed out so only
+// the mix, fades, limiter and ring copies are timed
+#include "test_common.h"
+#include "audio.h"
+#include <thread/thread.h>
+#include <math.h>
+#include <string.h>
+
+#define BENCH_RATE (48000)
+#define BENCH_CHANNELS (2)
+#define BENCH_BLOCK (512)
+
+static float _tone[48000 * BENCH_CHANNELS];
+
+// what a video with its audio already decoded hands the audio thread
+void video_getaudio_underlock(VideoId vid, float* frames, int num_frames, int num_channels, int sample_rate) {
+  (void)sample_rate;
+  int offset = (int)(vid.id * 97 % 4096) * num_channels;
+  memcpy(frames, _tone + offset, sizeof(float) * num_frames * num_channels);
+}
+
+int video_audiogen_underlock(VideoId vid) {
+  (void)vid;
+  return 0;
+}
+
+int main(void) {
+  test_init();
+  for (int i = 0; i < 48000; i++) {
+    for (int c = 0; c < BENCH_CHANNELS; c++) {
+      _tone[i * BENCH_CHANNELS + c] = 0.25f * sinf((float)i * 0.0575f);
+    }
+  }
+  thread_mutex_t mtx;
+  thread_mutex_init(&mtx);
+  audio_init(BENCH_RATE, BENCH_CHANNELS, &mtx);
+  float block[BENCH_BLOCK * BENCH_CHANNELS];
+  const int counts[] = {1, 8, 32, AUDIO_MAX_SOURCES};
+  for (int k = 0; k < (int)(sizeof(counts) / sizeof(counts[0])); k++) {
+    AudioSource sources[AUDIO_MAX_SOURCES];
+    for (int i = 0; i < counts[k]; i++) {
+      sources[i] = (AudioSource){.vid = {i + 1}, .gain = 0.5f, .from_start_secs = 1.0, .to_end_secs = 1e6};
+    }
+    thread_mutex_lock(&mtx);
+    audio_setsources_underlock(sources, counts[k]);
+    thread_mutex_unlock(&mtx);
+
+    // the ring is pulled as fast as it fills, but the audio thread still sleeps whenever it gets ahead, so only the
+    // time it spent mixing counts
+    AudioStats before = audio_stats(), after = before;
+    unsigned target_frames = (unsigned)test_iterations(60) * BENCH_RATE;
+    while ((unsigned)after.mixed_frames - (unsigned)before.mixed_frames < target_frames) {
+      audio_callback(block, BENCH_BLOCK, BENCH_CHANNELS);
+      AudioStats stats = audio_stats();
+      if (stats.mixed_frames == after.mixed_frames) {
+        thread_yield(); // nothing new, let the audio thread have the core
+      }
+      after = stats;
+    }
+    double mixed_secs = (double)((unsigned)after.mixed_frames - (unsigned)before.mixed_frames) / BENCH_RATE;
+    double busy_secs = (double)((unsigned)after.mix_usecs - (unsigned)before.mix_usecs) * 1e-6;
+    char name[64];
+    snprintf(name, sizeof(name), "mix %d sources", counts[k]);
+    test_report(name, mixed_secs / busy_secs, "x realtime");
+  }
+  audio_shutdown();
+  thread_mutex_term(&mtx);
+  return 0;
+}
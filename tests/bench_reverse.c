@@ -0,0 +1,74 @@
+// plays a long-GOP 1080p clip backwards at 1x through an async video, the way the preview does with J held, and
+// measures how smooth it is: how many frames show up late and the longest any one frame stays on screen
+#include "test_common.h"
+#include "test_media.h"
+#include "video.h"
+#include <thread/thread.h>
+
+#define BENCH_FPS (30)
+#define BENCH_UI_HZ (60) // the rate the preview calls video_nextframe at
+
+int main(int argc, char** argv) {
+  test_init();
+  videopool_init();
+  const char* path = argc > 1 ? argv[1] : "bench_reverse.mkv";
+  if (argc <= 1) {
+    TestMediaParams params = {.width = 1920, .height = 1080, .fps = BENCH_FPS, .secs = 20.0, .gop = BENCH_FPS * 4};
+    const char* err = testmedia_write(path, &params);
+    if (err) {
+      fprintf(stderr, "%s\n", err);
+      return 1;
+    }
+  }
+  thread_mutex_t aud_thread_mtx;
+  thread_mutex_init(&aud_thread_mtx);
+  thread_timer_t timer;
+  thread_timer_init(&timer);
+  VideoOpenRes res = video_open(path, &(VideoOpenParams){.profile = VideoOpenProfile_Export, .async_decode = true});
+  if (res.err) {
+    fprintf(stderr, "%s\n", res.err);
+    return 1;
+  }
+  VideoId vid = res.vid;
+  double frame_secs = video_frame_secs(vid);
+  double play_secs = test_iterations(1) * 10.0;
+  double pos_secs = video_total_secs(vid) - frame_secs;
+  play_secs = play_secs < pos_secs ? play_secs : pos_secs;
+
+  // let the first frames decode before the clock starts, like a prefetch would
+  video_setshuttle(vid, -1.0);
+  video_nextframe(vid, pos_secs, &aud_thread_mtx);
+  thread_timer_wait(&timer, 500000000);
+
+  VideoStats before = video_stats(vid);
+  int shown = before.frames_shown;
+  double start = test_secs(), last_shown = start, worst_hold = 0.0;
+  for (int tick = 1; tick <= (int)(play_secs * BENCH_UI_HZ); tick++) {
+    double due = start + (double)tick / BENCH_UI_HZ;
+    while (test_secs() < due) {
+      thread_timer_wait(&timer, 1000000);
+    }
+    video_nextframe(vid, pos_secs - (test_secs() - start), &aud_thread_mtx);
+    VideoStats stats = video_stats(vid);
+    if (stats.frames_shown != shown) {
+      shown = stats.frames_shown;
+      double now = test_secs();
+      worst_hold = now - last_shown > worst_hold ? now - last_shown : worst_hold;
+      last_shown = now;
+    }
+  }
+  VideoStats after = video_stats(vid);
+  int frames = after.frames_shown - before.frames_shown;
+  int expected = (int)(play_secs / frame_secs);
+  TEST_CHECK(frames > 0);
+  test_report("reverse frames shown", 100.0 * frames / expected, "%");
+  test_report("reverse frames late", 100.0 * (after.frames_late - before.frames_late) / expected, "%");
+  test_report("reverse frames dropped", 100.0 * (after.frames_dropped - before.frames_dropped) / expected, "%");
+  test_report("reverse worst hold", worst_hold * 1000.0, "ms");
+
+  video_close(vid);
+  thread_timer_term(&timer);
+  thread_mutex_term(&aud_thread_mtx);
+  videopool_shutdown();
+  return 0;
+}
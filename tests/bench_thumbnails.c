@@ -0,0 +1,48 @@
+// times video_decode_thumbnail over a clip the way the source panel asks for them, and checks each one shows the
+// keyframe at or before the position it was asked for
+#include "test_common.h"
+#include "test_media.h"
+#include "video.h"
+
+#define BENCH_FPS (30)
+
+int main(int argc, char** argv) {
+  test_init();
+  videopool_init();
+  // MPEG-TS offsets every timestamp, so the thumbnails are only right if the stream's start time is accounted for
+  const char* path = argc > 1 ? argv[1] : "bench_thumbnails.ts";
+  if (argc <= 1) {
+    TestMediaParams params = {.width = 1280, .height = 720, .fps = BENCH_FPS, .secs = 10.0, .gop = BENCH_FPS};
+    const char* err = testmedia_write(path, &params);
+    if (err) {
+      fprintf(stderr, "%s\n", err);
+      return 1;
+    }
+  }
+
+  int iterations = test_iterations(20);
+  double start = test_secs(), worst = 0.0;
+  for (int i = 0; i < iterations; i++) {
+    double pos_secs = 0.5 + (i % 9);
+    VideoThumbnail thumb = {.width = 320, .height = 180};
+    double t = test_secs();
+    const char* err = video_decode_thumbnail(path, pos_secs, &thumb);
+    t = test_secs() - t;
+    worst = t > worst ? t : worst;
+    if (err) {
+      fprintf(stderr, "%s\n", err);
+      return 1;
+    }
+    if (argc <= 1) {
+      int n = testmedia_framenumber(thumb.pixels, thumb.width, thumb.height, thumb.width * 4);
+      TEST_CHECK(n == (int)pos_secs * BENCH_FPS);
+    }
+    video_free_thumbnail(&thumb);
+  }
+  double secs = test_secs() - start;
+  test_report("thumbnail average", secs * 1000.0 / iterations, "ms");
+  test_report("thumbnail worst", worst * 1000.0, "ms");
+  test_report("thumbnails", iterations / secs, "per sec");
+  videopool_shutdown();
+  return 0;
+}
@@ -0,0 +1,66 @@
+// times building a clip's waveform from scratch, the way it happens the first time a file is dropped on the timeline,
+// and loading it back from the cache file afterwards
+#include "test_common.h"
+#include "test_media.h"
+#include "waveform.h"
+#include "file_cache.h"
+#include <thread/thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// waits for the background build or load and returns how long it took
+static double bench_open(const char* path, Waveform** out) {
+  double t = test_secs();
+  Waveform* wf = waveform_open(path, 0);
+  while (!waveform_ready(wf)) {
+    thread_yield();
+    TEST_CHECK(test_secs() - t < 600.0);
+  }
+  *out = wf;
+  return test_secs() - t;
+}
+
+int main(int argc, char** argv) {
+  test_init();
+  const char* path = argc > 1 ? argv[1] : "bench_waveform.wav";
+  double clip_secs = 600.0;
+  if (argc <= 1) {
+    TestMediaParams params = {.fps = 25, .secs = clip_secs, .audio_channels = 2, .audio_rate = 48000};
+    const char* err = testmedia_write(path, &params);
+    if (err) {
+      fprintf(stderr, "%s\n", err);
+      return 1;
+    }
+  }
+  char cachepath[1024];
+  TEST_CHECK(filecache_path(path, "fswav", cachepath, sizeof(cachepath)));
+
+  int iterations = test_iterations(3);
+  double build = 0.0, load = 0.0;
+  for (int i = 0; i < iterations; i++) {
+    remove(cachepath);
+    Waveform* wf;
+    build += bench_open(path, &wf);
+    int num;
+    double peak_secs;
+    const WaveformPeak* peaks = waveform_level(wf, 0.1, &num, &peak_secs);
+    TEST_CHECK(peaks && num > 0);
+    if (argc <= 1) {
+      // the test clip's sine peaks at 8000/32768 on both channels, about 31 whatever level the mono downmix is at
+      TEST_CHECK(num * peak_secs >= clip_secs - peak_secs);
+      TEST_CHECK(peaks[num / 2].max >= 20 && peaks[num / 2].max <= 45);
+      TEST_CHECK(abs(peaks[num / 2].min + peaks[num / 2].max) <= 1);
+    } else {
+      clip_secs = num * peak_secs;
+    }
+    waveform_free(wf);
+
+    load += bench_open(path, &wf);
+    TEST_CHECK(waveform_level(wf, 0.1, &num, &peak_secs) && num > 0);
+    waveform_free(wf);
+  }
+  test_report("waveform build", build * 1000.0 / iterations, "ms");
+  test_report("waveform build", clip_secs * iterations / build, "x realtime");
+  test_report("waveform cache load", load * 1000.0 / iterations, "ms");
+  return 0;
+}
@@ -0,0 +1,58 @@
+// throughput of the yuv_convert kernels next to sws_scale doing the same same-size conversion, for HD and UHD frames
+#include "test_common.h"
+#include "yuv_convert.h"
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <string.h>
+
+static void bench_format(enum AVPixelFormat format, int width, int height) {
+  AVFrame* f = av_frame_alloc();
+  f->format = format;
+  f->width = width;
+  f->height = height;
+  TEST_CHECK(av_frame_get_buffer(f, 0) == 0);
+  for (int p = 0; p < 4 && f->buf[p]; p++) {
+    memset(f->buf[p]->data, 0x40, f->buf[p]->size);
+  }
+  int linesize = width * 4;
+  uint8_t* dst = malloc((size_t)linesize * height);
+  int iterations = test_iterations(width * height > 1920 * 1080 ? 50 : 200);
+  double mpix = (double)width * height * iterations / 1e6;
+  char name[64];
+
+  double t = test_secs();
+  for (int i = 0; i < iterations; i++) {
+    TEST_CHECK(yuvconvert_frame(f, width >= 1280, false, dst, linesize));
+  }
+  t = test_secs() - t;
+  snprintf(name, sizeof(name), "yuvconvert %s %dx%d", av_get_pix_fmt_name(format), width, height);
+  test_report(name, mpix / t, "Mpixels/sec");
+
+  struct SwsContext* sws = sws_getContext(width, height, format, width, height, AV_PIX_FMT_RGBA, SWS_BILINEAR, NULL,
+                                          NULL, NULL);
+  uint8_t* dst_planes[4] = {dst};
+  int dst_linesize[4] = {linesize};
+  t = test_secs();
+  for (int i = 0; i < iterations; i++) {
+    sws_scale(sws, (const uint8_t* const*)f->data, f->linesize, 0, height, dst_planes, dst_linesize);
+  }
+  t = test_secs() - t;
+  snprintf(name, sizeof(name), "sws_scale  %s %dx%d", av_get_pix_fmt_name(format), width, height);
+  test_report(name, mpix / t, "Mpixels/sec");
+  sws_freeContext(sws);
+  free(dst);
+  av_frame_free(&f);
+}
+
+int main(void) {
+  test_init();
+  yuvconvert_init(3); // as many workers as the app uses
+  const enum AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_P010LE};
+  for (int i = 0; i < (int)(sizeof(formats) / sizeof(formats[0])); i++) {
+    bench_format(formats[i], 1920, 1080);
+    bench_format(formats[i], 3840, 2160);
+  }
+  yuvconvert_shutdown();
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include "test_common.h"
+#include <stdarg.h>
+#define SOKOL_TIME_IMPL
+#include <sokol/sokol_time.h>
+
+void test_init(void) {
+  stm_setup();
+  setvbuf(stdout, NULL, _IONBF, 0);
+}
+
+double test_secs(void) {
+  return stm_sec(stm_now());
+}
+
+void test_report(const char* name, double value, const char* unit) {
+  printf("%s: %.3f %s\n", name, value, unit);
+}
+
+int test_iterations(int n) {
+  const char* scale = getenv("FILMSAW_BENCH_SCALE");
+  double s = scale ? atof(scale) : 1.0;
+  int res = (int)(n * s);
+  return res > 0 ? res : 1;
+}
+
+#ifdef _DEBUG
+void DebugLog(const char* s, ...) {
+  va_list args;
+  va_start(args, s);
+  vprintf(s, args);
+  va_end(args);
+}
+#endif
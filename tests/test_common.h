@@ -0,0 +1,22 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// the little every test + benchmark shares: failing checks, timing and reporting results in one greppable format
+
+#define TEST_CHECK(cond)                                                                                               \
+  do {                                                                                                                 \
+    if (!(cond)) {                                                                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                        \
+      exit(1);                                                                                                         \
+    }                                                                                                                  \
+  } while (0)
+
+void test_init(void);
+double test_secs(void); // seconds since test_init
+// prints "name: value unit", the line the benchmarks are compared by
+void test_report(const char* name, double value, const char* unit);
+// how many times benchmarks repeat their work, FILMSAW_BENCH_SCALE multiplies it so CI can keep the runs short
+int test_iterations(int n);
@@ -0,0 +1,195 @@
+#include "test_media.h"
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <math.h>
+
+// the frame number is drawn as a row of 16 black/white bits across the top of the frame, each block big enough to
+// survive the lossy encode
+#define TESTMEDIA_BITS (16)
+#define TESTMEDIA_TAU (6.283185307179586)
+
+static void testmedia_drawframe(AVFrame* f, int n) {
+  int block = f->width / TESTMEDIA_BITS;
+  for (int y = 0; y < f->height; y++) {
+    for (int x = 0; x < f->width; x++) {
+      int bit = x / block;
+      uint8_t luma = (uint8_t)(x + y * 2 + n * 3);
+      if (y < block && bit < TESTMEDIA_BITS) {
+        luma = (n >> bit) & 1 ? 235 : 16;
+      }
+      f->data[0][y * f->linesize[0] + x] = luma;
+    }
+  }
+  for (int y = 0; y < f->height / 2; y++) {
+    for (int x = 0; x < f->width / 2; x++) {
+      bool header = y * 2 < block;
+      f->data[1][y * f->linesize[1] + x] = header ? 128 : (uint8_t)(128 + y + n);
+      f->data[2][y * f->linesize[2] + x] = header ? 128 : (uint8_t)(64 + x * 2);
+    }
+  }
+}
+
+int testmedia_framenumber(const uint8_t* rgba, int width, int height, int linesize) {
+  int block = width / TESTMEDIA_BITS;
+  if (height < block) {
+    return -1;
+  }
+  int n = 0;
+  for (int bit = 0; bit < TESTMEDIA_BITS; bit++) {
+    const uint8_t* p = rgba + (block / 2) * linesize + (bit * block + block / 2) * 4;
+    n |= (p[1] > 128) << bit;
+  }
+  return n;
+}
+
+static const char* testmedia_encode(AVFormatContext* fmt_ctx, AVCodecContext* codec_ctx, AVStream* stream,
+                                    AVFrame* frame, AVPacket* pkt) {
+  if (avcodec_send_frame(codec_ctx, frame) < 0) {
+    return "Failed to encode";
+  }
+  for (;;) {
+    int ret = avcodec_receive_packet(codec_ctx, pkt);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+      return NULL;
+    } else if (ret < 0) {
+      return "Failed to encode";
+    }
+    av_packet_rescale_ts(pkt, codec_ctx->time_base, stream->time_base);
+    pkt->stream_index = stream->index;
+    if (av_interleaved_write_frame(fmt_ctx, pkt) < 0) {
+      return "Failed to write packet";
+    }
+  }
+}
+
+static AVCodecContext* testmedia_openencoder(AVFormatContext* fmt_ctx, enum AVCodecID id, AVStream** stream) {
+  const AVCodec* codec = avcodec_find_encoder(id);
+  *stream = codec ? avformat_new_stream(fmt_ctx, NULL) : NULL;
+  if (*stream == NULL) {
+    return NULL;
+  }
+  return avcodec_alloc_context3(codec);
+}
+
+const char* testmedia_write(const char* path, const TestMediaParams* p) {
+  AVFormatContext* fmt_ctx = NULL;
+  AVCodecContext *vid_ctx = NULL, *aud_ctx = NULL;
+  AVStream *vid_stream = NULL, *aud_stream = NULL;
+  AVFrame* frame = av_frame_alloc();
+  AVPacket* pkt = av_packet_alloc();
+  const char* err = NULL;
+  if (avformat_alloc_output_context2(&fmt_ctx, NULL, NULL, path) < 0) {
+    err = "Unknown container";
+    goto cleanup;
+  }
+  // no width writes an audio only file
+  if (p->width > 0) {
+    vid_ctx = testmedia_openencoder(fmt_ctx, AV_CODEC_ID_MPEG4, &vid_stream);
+    if (vid_ctx == NULL) {
+      err = "Failed to create the video encoder";
+      goto cleanup;
+    }
+    vid_ctx->width = p->width;
+    vid_ctx->height = p->height;
+    vid_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    vid_ctx->time_base = (AVRational){1, p->fps};
+    vid_ctx->framerate = (AVRational){p->fps, 1};
+    vid_ctx->gop_size = p->gop;
+    vid_ctx->max_b_frames = 0;
+    vid_ctx->global_quality = FF_QP2LAMBDA * 4;
+    vid_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    if (fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+      vid_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (avcodec_open2(vid_ctx, NULL, NULL) < 0 || avcodec_parameters_from_context(vid_stream->codecpar, vid_ctx) < 0) {
+      err = "Failed to open the video encoder";
+      goto cleanup;
+    }
+    vid_stream->time_base = vid_ctx->time_base;
+    vid_stream->avg_frame_rate = vid_ctx->framerate;
+  }
+  if (p->audio_channels > 0) {
+    aud_ctx = testmedia_openencoder(fmt_ctx, AV_CODEC_ID_PCM_S16LE, &aud_stream);
+    if (aud_ctx == NULL) {
+      err = "Failed to create the audio encoder";
+      goto cleanup;
+    }
+    aud_ctx->sample_fmt = AV_SAMPLE_FMT_S16;
+    aud_ctx->sample_rate = p->audio_rate;
+    aud_ctx->time_base = (AVRational){1, p->audio_rate};
+    av_channel_layout_default(&aud_ctx->ch_layout, p->audio_channels);
+    if (avcodec_open2(aud_ctx, NULL, NULL) < 0 ||
+        avcodec_parameters_from_context(aud_stream->codecpar, aud_ctx) < 0) {
+      err = "Failed to open the audio encoder";
+      goto cleanup;
+    }
+    aud_stream->time_base = aud_ctx->time_base;
+  }
+  if (avio_open(&fmt_ctx->pb, path, AVIO_FLAG_WRITE) < 0 || avformat_write_header(fmt_ctx, NULL) < 0) {
+    err = "Failed to write the header";
+    goto cleanup;
+  }
+
+  int num_frames = (int)(p->secs * p->fps);
+  int aud_frame_size = p->audio_rate / p->fps; // one audio packet per video frame
+  int64_t aud_pts = 0;
+  for (int n = 0; n < num_frames && err == NULL; n++) {
+    if (vid_ctx) {
+      av_frame_unref(frame);
+      frame->format = AV_PIX_FMT_YUV420P;
+      frame->width = p->width;
+      frame->height = p->height;
+      if (av_frame_get_buffer(frame, 0) < 0) {
+        err = "Out of memory";
+        break;
+      }
+      testmedia_drawframe(frame, n);
+      frame->pts = n;
+      err = testmedia_encode(fmt_ctx, vid_ctx, vid_stream, frame, pkt);
+    }
+    if (aud_ctx && err == NULL) {
+      av_frame_unref(frame);
+      frame->format = AV_SAMPLE_FMT_S16;
+      frame->sample_rate = p->audio_rate;
+      frame->nb_samples = aud_frame_size;
+      av_channel_layout_copy(&frame->ch_layout, &aud_ctx->ch_layout);
+      if (av_frame_get_buffer(frame, 0) < 0) {
+        err = "Out of memory";
+        break;
+      }
+      int16_t* samples = (int16_t*)frame->data[0];
+      for (int i = 0; i < aud_frame_size; i++) {
+        double t = (double)(aud_pts + i) / p->audio_rate;
+        int16_t s = (int16_t)(sin(t * 440.0 * TESTMEDIA_TAU) * 8000.0);
+        for (int c = 0; c < p->audio_channels; c++) {
+          samples[i * p->audio_channels + c] = s;
+        }
+      }
+      frame->pts = aud_pts;
+      aud_pts += aud_frame_size;
+      err = testmedia_encode(fmt_ctx, aud_ctx, aud_stream, frame, pkt);
+    }
+  }
+  if (err == NULL && vid_ctx) {
+    err = testmedia_encode(fmt_ctx, vid_ctx, vid_stream, NULL, pkt);
+  }
+  if (err == NULL && aud_ctx) {
+    err = testmedia_encode(fmt_ctx, aud_ctx, aud_stream, NULL, pkt);
+  }
+  if (err == NULL && av_write_trailer(fmt_ctx) < 0) {
+    err = "Failed to write the trailer";
+  }
+cleanup:
+  av_packet_free(&pkt);
+  av_frame_free(&frame);
+  avcodec_free_context(&vid_ctx);
+  avcodec_free_context(&aud_ctx);
+  if (fmt_ctx) {
+    if (fmt_ctx->pb) {
+      avio_closep(&fmt_ctx->pb);
+    }
+    avformat_free_context(fmt_ctx);
+  }
+  return err;
+}
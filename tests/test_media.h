@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// writes small synthetic clips for the tests to decode, so they don't depend on media files being around. the video
+// is MPEG-4 part 2 and the audio 16-bit PCM, both have encoders in every FFmpeg build
+
+typedef struct {
+  int width, height;             // 0 writes no video stream
+  int fps;                       // audio is written in packets of 1/fps seconds too
+  double secs;
+  int gop;                       // frames between keyframes
+  int audio_channels;            // 0 writes no audio stream
+  int audio_rate;
+} TestMediaParams;
+
+// writes the clip to path (the extension picks the container), returns an error or NULL on success. frame n shows
+// a gradient that moves with n and the audio is a 440Hz sine
+const char* testmedia_write(const char* path, const TestMediaParams* p);
+// the number shown by frame n, testmedia_framenumber reads it back from an RGBA image of the whole frame
+int testmedia_framenumber(const uint8_t* rgba, int width, int height, int linesize);
@@ -0,0 +1,3 @@
+// sokol_gfx for the code under test, the backend comes from the build like the app's
+#define SOKOL_GFX_IMPL
+#include <sokol/sokol_gfx.h>
@@ -0,0 +1,129 @@
+// checks which clips get decode cursors of their own: the slices of a run share one, both after an edit splits a run
+// and when a project is loaded, and cursors opened in the background end up on the right clips
+#include "test_common.h"
+#include "test_media.h"
+#include "video_clips.h"
+#include <thread/thread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// thumbnails aren't looked at here
+ThumbnailId thumbnails_request(const char* path, double pos_secs, int width, int height, int priority) {
+  (void)path, (void)pos_secs, (void)width, (void)height, (void)priority;
+  return (ThumbnailId){0};
+}
+void thumbnails_cancel(ThumbnailId id) {
+  (void)id;
+}
+
+static VideoClip test_slice(VideoId vid, int track, double pos, double clipstart, double clipend) {
+  return (VideoClip){.vid = vid, .track = track, .pos = pos, .clipstart = clipstart, .clipend = clipend};
+}
+
+// a run of three slices has its middle one deleted, the slice after the gap moves to a cursor of its own
+static void test_splitrun(void) {
+  VideoId vid = {1}, cursor = {2};
+  VideoClips clips = {0};
+  videoclips_push(&clips, test_slice(vid, 0, 0.0, 0.0, 2.0));
+  videoclips_push(&clips, test_slice(vid, 0, 2.0, 2.0, 4.0));
+  videoclips_push(&clips, test_slice(vid, 0, 4.0, 4.0, 6.0));
+  int runs[4];
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 0);
+
+  clips.clips[1] = clips.clips[--clips.num];
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 1);
+  TEST_CHECK(clips.clips[runs[0]].pos == 4.0);
+  TEST_CHECK(videoclips_moverun(&clips, vid, 0, 4.0, cursor) == 1);
+  TEST_CHECK(clips.clips[0].vid.id == vid.id && clips.clips[1].vid.id == cursor.id);
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 0);
+
+  // the run has gone, or it's the last one on its video
+  TEST_CHECK(videoclips_moverun(&clips, vid, 0, 4.0, (VideoId){3}) == 0);
+  TEST_CHECK(videoclips_moverun(&clips, vid, 0, 0.0, (VideoId){3}) == 0);
+  free(clips.clips);
+}
+
+// a slice moved to another track or away from its run is a run of its own, one sliced off in place isn't
+static void test_runs(void) {
+  VideoId vid = {1};
+  VideoClips clips = {0};
+  videoclips_push(&clips, test_slice(vid, 0, 0.0, 0.0, 2.0));
+  videoclips_push(&clips, test_slice(vid, 0, 2.0, 2.0, 4.0));
+  videoclips_push(&clips, test_slice(vid, 1, 4.0, 4.0, 6.0));
+  videoclips_push(&clips, test_slice(vid, 0, 8.0, 4.0, 6.0));
+  videoclips_push(&clips, test_slice(vid, 0, 4.0, 6.0, 8.0));
+  double start, end;
+  videoclips_runextent(&clips, &clips.clips[1], &start, &end);
+  TEST_CHECK(start == 0.0 && end == 4.0);
+  int runs[4];
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 3);
+  TEST_CHECK(runs[0] == 2 && runs[1] == 3 && runs[2] == 4);
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 1) == 1);
+  free(clips.clips);
+}
+
+static VideoOpenRes test_waitcursor(VideoCursorOpen* op) {
+  VideoOpenRes res;
+  double start = test_secs();
+  while (!video_opencursor_ready(op, &res)) {
+    TEST_CHECK(test_secs() - start < 30.0);
+    thread_yield();
+  }
+  return res;
+}
+
+int main(void) {
+  test_init();
+  videopool_init();
+  test_runs();
+  test_splitrun();
+
+  const char* media = "test_video_clips.mkv";
+  TestMediaParams params = {.width = 320, .height = 240, .fps = 25, .secs = 8.0, .gop = 25};
+  const char* err = testmedia_write(media, &params);
+  if (err) {
+    fprintf(stderr, "%s\n", err);
+    return 1;
+  }
+  VideoOpenParams openparams = {.profile = VideoOpenProfile_Export};
+  VideoOpenRes res = video_open(media, &openparams);
+  TEST_CHECK(res.err == NULL);
+
+  // a run of two slices, the same source later on the track and once more on another track
+  VideoClips saved = {0};
+  videoclips_push(&saved, test_slice(res.vid, 0, 0.0, 0.0, 2.0));
+  videoclips_push(&saved, test_slice(res.vid, 0, 2.0, 2.0, 4.0));
+  videoclips_push(&saved, test_slice(res.vid, 0, 10.0, 0.0, 2.0));
+  videoclips_push(&saved, test_slice(res.vid, 1, 0.0, 4.0, 6.0));
+  TEST_CHECK(videoclips_save("test_video_clips.json", &saved) == NULL);
+  free(saved.clips);
+
+  VideoClips clips = {0};
+  TEST_CHECK(videoclips_load("test_video_clips.json", &clips, &openparams) == NULL);
+  TEST_CHECK(clips.num == 4);
+  VideoClip* c = clips.clips;
+  TEST_CHECK(c[0].vid.id == c[1].vid.id);
+  TEST_CHECK(c[2].vid.id != c[0].vid.id && c[3].vid.id != c[0].vid.id && c[3].vid.id != c[2].vid.id);
+  TEST_CHECK(c[1].clipstart == 2.0 && c[3].track == 1);
+  int runs[4];
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 0);
+
+  // moving the second slice away separates it from its run, it gets a cursor opened in the background
+  c[1].pos = 6.0;
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 1 && runs[0] == 1);
+  VideoId shared = c[1].vid;
+  res = test_waitcursor(video_opencursor_async(shared));
+  TEST_CHECK(res.err == NULL && res.vid.id != shared.id);
+  TEST_CHECK(strcmp(video_filepath(res.vid), video_filepath(shared)) == 0);
+  TEST_CHECK(video_total_secs(res.vid) == video_total_secs(shared));
+  TEST_CHECK(videoclips_moverun(&clips, shared, 0, 6.0, res.vid) == 1);
+  TEST_CHECK(c[1].vid.id == res.vid.id && c[0].vid.id == shared.id);
+  TEST_CHECK(videoclips_sharedruns(&clips, runs, 4) == 0);
+
+  // one that isn't wanted any more is closed whether or not it has finished opening
+  video_opencursor_cancel(video_opencursor_async(shared));
+
+  free(clips.clips);
+  videopool_shutdown();
+  return 0;
+}
@@ -0,0 +1,94 @@
+// checks the yuv_convert kernels against swscale for every format, matrix and range they handle
+#include "test_common.h"
+#include "yuv_convert.h"
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+// odd multiples of the kernel widths, so the scalar tails run too, and tall enough to be split across the workers
+#define TEST_WIDTH (1000)
+#define TEST_HEIGHT (300)
+
+// smooth ramps so swscale's chroma interpolation doesn't matter, but reaching saturated colours and both ends of the
+// luma range where a wrong matrix or range shows up the most
+static void test_fillframe(AVFrame* f) {
+  const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(f->format);
+  int depth = desc->comp[0].depth, shift = desc->comp[0].shift;
+  for (int c = 0; c < desc->nb_components; c++) {
+    const AVComponentDescriptor* comp = &desc->comp[c];
+    int w = c ? AV_CEIL_RSHIFT(f->width, desc->log2_chroma_w) : f->width;
+    int h = c ? AV_CEIL_RSHIFT(f->height, desc->log2_chroma_h) : f->height;
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        int v = c == 0 ? x * 256 / w : c == 1 ? y * 256 / h : 255 - x * 256 / w;
+        v = (v << (depth - 8)) << shift;
+        uint8_t* p = f->data[comp->plane] + y * f->linesize[comp->plane] + x * comp->step + comp->offset;
+        if (depth > 8) {
+          *(uint16_t*)p = (uint16_t)v;
+        } else {
+          *p = (uint8_t)v;
+        }
+      }
+    }
+  }
+}
+
+static void test_format(enum AVPixelFormat format, bool bt709, bool full_range) {
+  AVFrame* f = av_frame_alloc();
+  f->format = format;
+  f->width = TEST_WIDTH;
+  f->height = TEST_HEIGHT;
+  TEST_CHECK(av_frame_get_buffer(f, 0) == 0);
+  test_fillframe(f);
+  int linesize = TEST_WIDTH * 4;
+  uint8_t* ours = malloc((size_t)linesize * TEST_HEIGHT);
+  uint8_t* ref = malloc((size_t)linesize * TEST_HEIGHT);
+  TEST_CHECK(yuvconvert_frame(f, bt709, full_range, ours, linesize));
+
+  struct SwsContext* sws = sws_getContext(TEST_WIDTH, TEST_HEIGHT, format, TEST_WIDTH, TEST_HEIGHT, AV_PIX_FMT_RGBA,
+                                          SWS_POINT | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT, NULL, NULL, NULL);
+  TEST_CHECK(sws);
+  const int* coeffs = sws_getCoefficients(bt709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+  sws_setColorspaceDetails(sws, coeffs, full_range, sws_getCoefficients(SWS_CS_DEFAULT), 1, 0, 1 << 16, 1 << 16);
+  uint8_t* dst[4] = {ref};
+  int dst_linesize[4] = {linesize};
+  sws_scale(sws, (const uint8_t* const*)f->data, f->linesize, 0, TEST_HEIGHT, dst, dst_linesize);
+  sws_freeContext(sws);
+
+  int max_diff = 0;
+  double sum_diff = 0.0;
+  for (int y = 0; y < TEST_HEIGHT; y++) {
+    for (int x = 0; x < TEST_WIDTH * 4; x++) {
+      int d = abs(ours[y * linesize + x] - ref[y * linesize + x]);
+      max_diff = d > max_diff ? d : max_diff;
+      sum_diff += d;
+    }
+  }
+  double mean_diff = sum_diff / (TEST_WIDTH * 4.0 * TEST_HEIGHT);
+  printf("%-12s %s %-7s max diff %d, mean %.3f\n", av_get_pix_fmt_name(format), bt709 ? "bt709" : "bt601",
+         full_range ? "full" : "limited", max_diff, mean_diff);
+  // the kernels are 16-bit fixed point, a wrong matrix or range is off by tens
+  TEST_CHECK(max_diff <= 4 && mean_diff < 1.0);
+  free(ours);
+  free(ref);
+  av_frame_free(&f);
+}
+
+int main(void) {
+  test_init();
+  yuvconvert_init(4);
+  const enum AVPixelFormat formats[] = {
+      AV_PIX_FMT_YUV420P,     AV_PIX_FMT_YUV422P,     AV_PIX_FMT_NV12,   AV_PIX_FMT_YUV420P10LE,
+      AV_PIX_FMT_YUV422P10LE, AV_PIX_FMT_P010LE,
+  };
+  for (int i = 0; i < (int)(sizeof(formats) / sizeof(formats[0])); i++) {
+    for (int m = 0; m < 4; m++) {
+      test_format(formats[i], m & 1, m & 2);
+    }
+  }
+  // the JPEG formats are always full range
+  test_format(AV_PIX_FMT_YUVJ420P, false, true);
+  test_format(AV_PIX_FMT_YUVJ422P, true, true);
+  yuvconvert_shutdown();
+  return 0;
+}
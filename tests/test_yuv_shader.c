@@ -0,0 +1,190 @@
+// draws YUV planes through data/yuv.h the way video_uploadplanes does and compares the pixels read back against the
+// BT.601/BT.709 maths in doubles. it runs headless on Mesa's llvmpipe through a surfaceless EGL context, and is
+// skipped when there's no GL 3.3 driver to be had
+#include "test_common.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <math.h>
+#define SOKOL_GFX_IMPL
+#include <sokol/sokol_gfx.h>
+#include "../data/yuv.h"
+
+#define TEST_SKIP (77)
+#define TEST_WIDTH (64)
+#define TEST_HEIGHT (48)
+
+typedef enum {
+  TestLayout_420p,
+  TestLayout_422p,
+  TestLayout_Nv12,
+} TestLayout;
+
+static bool test_initgl(void) {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_display =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  EGLDisplay dpy = get_display ? get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : NULL;
+  if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API)) {
+    return false;
+  }
+  const EGLint config_attrs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(dpy, config_attrs, &config, 1, &num_configs) || num_configs == 0) {
+    return false;
+  }
+  const EGLint context_attrs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                  EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+  EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, context_attrs);
+  return ctx != EGL_NO_CONTEXT && eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+}
+
+// the same uniforms as video_yuvparams
+static yuv_fs_params_t test_yuvparams(bool bt709, bool full_range, bool nv12) {
+  float kr = bt709 ? 0.2126f : 0.299f, kb = bt709 ? 0.0722f : 0.114f, kg = 1.0f - kr - kb;
+  float ys = full_range ? 1.0f : 255.0f / 219.0f, cs = full_range ? 1.0f : 255.0f / 224.0f;
+  return (yuv_fs_params_t){
+      .coeff_r = {ys, 0.0f, 2.0f * (1.0f - kr) * cs},
+      .coeff_g = {ys, -2.0f * kb * (1.0f - kb) / kg * cs, -2.0f * kr * (1.0f - kr) / kg * cs},
+      .coeff_b = {ys, 2.0f * (1.0f - kb) * cs, 0.0f},
+      .offset = {full_range ? 0.0f : 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f, nv12 ? 1.0f : 0.0f},
+  };
+}
+
+// ramps across the whole range, the chroma ones in opposite directions so every pixel has a different colour
+static uint8_t test_sample(int plane, int x, int y, int w, int h) {
+  return (uint8_t)(plane == 0 ? 16 + x * 219 / w : plane == 1 ? 32 + y * 192 / h : 224 - x * 192 / w);
+}
+
+// what linear filtering reads from a chroma plane at the centre of output pixel x, y
+static double test_chroma(int plane, int x, int y, int cw, int ch, int h) {
+  double fx = x * 0.5 - 0.25, fy = ch == h ? y : y * 0.5 - 0.25;
+  int x0 = (int)floor(fx), y0 = (int)floor(fy);
+  double ax = fx - x0, ay = fy - y0, res = 0.0;
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 2; i++) {
+      int sx = x0 + i < 0 ? 0 : x0 + i >= cw ? cw - 1 : x0 + i;
+      int sy = y0 + j < 0 ? 0 : y0 + j >= ch ? ch - 1 : y0 + j;
+      res += test_sample(plane, sx, sy, cw, ch) * (i ? ax : 1.0 - ax) * (j ? ay : 1.0 - ay);
+    }
+  }
+  return res;
+}
+
+static double test_reference(const double yuv[3], int c, bool bt709, bool full_range) {
+  double kr = bt709 ? 0.2126 : 0.299, kb = bt709 ? 0.0722 : 0.114, kg = 1.0 - kr - kb;
+  double ys = full_range ? 1.0 : 255.0 / 219.0, cs = full_range ? 1.0 : 255.0 / 224.0;
+  double y = (yuv[0] - (full_range ? 0.0 : 16.0)) * ys, u = (yuv[1] - 128.0) * cs, v = (yuv[2] - 128.0) * cs;
+  double rgb[3] = {y + 2.0 * (1.0 - kr) * v, y - 2.0 * kb * (1.0 - kb) / kg * u - 2.0 * kr * (1.0 - kr) / kg * v,
+                   y + 2.0 * (1.0 - kb) * u};
+  return rgb[c] < 0.0 ? 0.0 : rgb[c] > 255.0 ? 255.0 : rgb[c];
+}
+
+static void test_layout(sg_pipeline pip, sg_buffer quad, TestLayout layout, bool bt709, bool full_range) {
+  bool nv12 = layout == TestLayout_Nv12;
+  int w = TEST_WIDTH, h = TEST_HEIGHT, cw = w / 2, ch = layout == TestLayout_422p ? h : h / 2;
+  static uint8_t planes[3][TEST_WIDTH * TEST_HEIGHT * 2];
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      planes[0][y * w + x] = test_sample(0, x, y, w, h);
+    }
+  }
+  for (int y = 0; y < ch; y++) {
+    for (int x = 0; x < cw; x++) {
+      uint8_t u = test_sample(1, x, y, cw, ch), v = test_sample(2, x, y, cw, ch);
+      if (nv12) {
+        planes[1][(y * cw + x) * 2] = u;
+        planes[1][(y * cw + x) * 2 + 1] = v;
+      } else {
+        planes[1][y * cw + x] = u;
+        planes[2][y * cw + x] = v;
+      }
+    }
+  }
+  sg_image img[3] = {0};
+  for (int i = 0; i < (nv12 ? 2 : 3); i++) {
+    img[i] = sg_make_image(&(sg_image_desc){
+        .width = i == 0 ? w : cw,
+        .height = i == 0 ? h : ch,
+        .pixel_format = nv12 && i == 1 ? SG_PIXELFORMAT_RG8 : SG_PIXELFORMAT_R8,
+        .min_filter = SG_FILTER_LINEAR,
+        .mag_filter = SG_FILTER_LINEAR,
+        .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+        .data.subimage[0][0] = {.ptr = planes[i], .size = (size_t)(i == 0 ? w * h : cw * ch * (nv12 ? 2 : 1))},
+    });
+  }
+  sg_image target = sg_make_image(&(sg_image_desc){
+      .render_target = true,
+      .width = w,
+      .height = h,
+      .pixel_format = SG_PIXELFORMAT_RGBA8,
+      .sample_count = 1,
+  });
+  sg_pass pass = sg_make_pass(&(sg_pass_desc){.color_attachments[0].image = target});
+  yuv_fs_params_t params = test_yuvparams(bt709, full_range, nv12);
+  sg_begin_pass(pass, &(sg_pass_action){.colors[0].action = SG_ACTION_DONTCARE});
+  sg_apply_pipeline(pip);
+  sg_apply_bindings(&(sg_bindings){
+      .vertex_buffers[0] = quad,
+      .fs_images = {[SLOT_yuv_tex_y] = img[0], [SLOT_yuv_tex_u] = img[1], [SLOT_yuv_tex_v] = img[nv12 ? 1 : 2]},
+  });
+  sg_apply_uniforms(SG_SHADERSTAGE_FS, SLOT_yuv_fs_params, &SG_RANGE(params));
+  sg_draw(0, 4, 1);
+  // the pass's framebuffer is still bound until sg_end_pass
+  static uint8_t pixels[TEST_WIDTH * TEST_HEIGHT * 4];
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  sg_end_pass();
+  sg_commit();
+
+  double max_diff = 0.0;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      double yuv[3] = {planes[0][y * w + x], test_chroma(1, x, y, cw, ch, h), test_chroma(2, x, y, cw, ch, h)};
+      for (int c = 0; c < 3; c++) {
+        double d = fabs(pixels[(y * w + x) * 4 + c] - test_reference(yuv, c, bt709, full_range));
+        max_diff = d > max_diff ? d : max_diff;
+      }
+    }
+  }
+  const char* names[] = {"yuv420p", "yuv422p", "nv12"};
+  printf("%-8s %s %-7s max diff %.2f\n", names[layout], bt709 ? "bt709" : "bt601", full_range ? "full" : "limited",
+         max_diff);
+  // 8-bit texels, filtering and output, a wrong matrix, range or plane is off by tens
+  TEST_CHECK(max_diff <= 2.0);
+  sg_destroy_pass(pass);
+  sg_destroy_image(target);
+  for (int i = 0; i < 3; i++) {
+    sg_destroy_image(img[i]);
+  }
+}
+
+int main(void) {
+  test_init();
+  if (!test_initgl()) {
+    printf("no GL 3.3 context, skipping\n");
+    return TEST_SKIP;
+  }
+  sg_setup(&(sg_desc){0});
+  TEST_CHECK(sg_isvalid() && sg_query_backend() == SG_BACKEND_GLCORE33);
+  // a quad like video_yuvpipeline's GL one, so row 0 of the read back pixels is row 0 of the planes
+  float quad[] = {-1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+  sg_buffer vbuf = sg_make_buffer(&(sg_buffer_desc){.data = SG_RANGE(quad)});
+  sg_pipeline pip = sg_make_pipeline(&(sg_pipeline_desc){
+      .shader = sg_make_shader(yuv_shader_desc(sg_query_backend())),
+      .layout.attrs = {[ATTR_yuv_vs_position].format = SG_VERTEXFORMAT_FLOAT2,
+                       [ATTR_yuv_vs_texcoord0].format = SG_VERTEXFORMAT_FLOAT2},
+      .primitive_type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
+      .depth.pixel_format = SG_PIXELFORMAT_NONE,
+      .colors[0].pixel_format = SG_PIXELFORMAT_RGBA8,
+      .sample_count = 1,
+  });
+  TEST_CHECK(sg_query_pipeline_state(pip) == SG_RESOURCESTATE_VALID);
+  for (int layout = 0; layout < 3; layout++) {
+    for (int m = 0; m < 4; m++) {
+      test_layout(pip, vbuf, layout, m & 1, m & 2);
+    }
+  }
+  sg_shutdown();
+  return 0;
+}